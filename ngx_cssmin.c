@@ -41,6 +41,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <ngx_core.h>
+#include "ngx_cssmin.h"
+
+#if (__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define STATE_FREE 1
 #define STATE_ATRULE 2
@@ -49,40 +54,12 @@
 #define STATE_DECLARATION 5
 #define STATE_COMMENT 6
 
-static int theLookahead = EOF, tmp_state, state = 1, in_paren = 0;
-
-
-static int ngx_getc(ngx_buf_t *in)
-{
-    if (in->pos > in->end) {
-        return EOF;
-    }
-    u_char c = in->pos[0];
-    ++in->pos;
-    return c;
-}
-
-static void ngx_putc(u_char c,ngx_buf_t *out)
-{
-    if (out->pos<=out->end) {
-         out->pos[0] = c;
-        ++out->pos;
-    }
-}
 
-/* get -- return the next character from in. Watch out for lookahead. If
- * the character is a control character, translate it to a space or
- * linefeed.
+/* get -- translate a control character to a space or linefeed.
  */
 
-static int get(ngx_buf_t *in)
+static int get(int c)
 {
-    int c = theLookahead;
-    theLookahead = EOF;
-    if (c == EOF) {
-        c = ngx_getc(in);
-    }
-
     if (c >= ' ' || c == '\n' || c == EOF) {
         return c;
     }
@@ -94,52 +71,46 @@ static int get(ngx_buf_t *in)
     return ' ';
 }
 
-/*
- * peek -- get the next character without getting it.
- */
-
-static int peek(ngx_buf_t *in)
-{
-    theLookahead = get(in);
-    return theLookahead;
-}
-
 /* 
- *machine
+ * machine -- c is the current character and peek the one after it, or EOF.
+ * *skip is set if the machine consumed peek as well.
  */
 
-static int machine(int c,ngx_buf_t *in)
+static int machine(ngx_cssmin_t *ctx, int c, int peek, ngx_uint_t *skip)
 {
-    if (state != STATE_COMMENT) {
-        if (c == '/' && peek(in) == '*') {
-            tmp_state = state;
-            state = STATE_COMMENT;
+    if (ctx->state != STATE_COMMENT) {
+        if (c == '/' && peek == '*') {
+            ctx->tmp_state = ctx->state;
+            ctx->state = STATE_COMMENT;
         }
     }
     
-    switch (state) {
+    switch (ctx->state) {
         case STATE_FREE:
-            if (c == ' ' && c == '\n' ) {
+            if (c == ' ' || c == '\n') {
                 c = 0;
 
             } else if (c == '@') {
-                state = STATE_ATRULE;
+                ctx->state = STATE_ATRULE;
                 break;
 
             } else if (c > 0) {
-                state = STATE_SELECTOR;
+                ctx->state = STATE_SELECTOR;
             }
+
+            /* fall through */
+
         case STATE_SELECTOR:
             if (c == '{') {
-                state = STATE_BLOCK;
+                ctx->state = STATE_BLOCK;
 
             } else if (c == '\n') {
                 c = 0;
 
             } else if (c == '@') {
-                state = STATE_ATRULE;
+                ctx->state = STATE_ATRULE;
 
-            } else if (c == ' ' && peek(in) == '{') {
+            } else if (c == ' ' && peek == '{') {
                 c = 0;
             }
             break;
@@ -150,10 +121,10 @@ static int machine(int c,ngx_buf_t *in)
             */
             if (c == '\n' || c == ';') {
                 c = ';';
-                state = STATE_FREE;
+                ctx->state = STATE_FREE;
 
             } else if (c == '{') {
-                state = STATE_BLOCK;
+                ctx->state = STATE_BLOCK;
             }
             break;
         case STATE_BLOCK:
@@ -162,29 +133,32 @@ static int machine(int c,ngx_buf_t *in)
                 break;
 
             } else if (c == '}') {
-                state = STATE_FREE;
+                ctx->state = STATE_FREE;
                 break;
 
             } else {
-                state = STATE_DECLARATION;
+                ctx->state = STATE_DECLARATION;
             }
+
+            /* fall through */
+
         case STATE_DECLARATION:
             //support in paren because data can uris have ;
             if (c == '(') {
-                in_paren = 1;
+                ctx->in_paren = 1;
             }
-            if (in_paren == 0) {
+            if (ctx->in_paren == 0) {
                 
                 if ( c == ';') {
-                    state = STATE_BLOCK;
+                    ctx->state = STATE_BLOCK;
                     //could continue peeking through white space..
-                    if (peek(in) == '}') {
+                    if (peek == '}') {
                         c = 0;
                     }
 
                 } else if (c == '}') {
                     //handle unterminated declaration
-                    state = STATE_FREE;
+                    ctx->state = STATE_FREE;
 
                 } else if ( c == '\n') {
                   //skip new lines
@@ -192,20 +166,20 @@ static int machine(int c,ngx_buf_t *in)
 
                 } else if (c == ' ' ) {
                   //skip multiple spaces after each other
-                  if ( peek(in) == c ) {
+                  if ( peek == c ) {
                       c = 0;
                     }
                 }
                 
             } else if (c == ')') {
-                in_paren = 0;
+                ctx->in_paren = 0;
             }
 
             break;
         case STATE_COMMENT:
-            if (c == '*' && peek(in) == '/') {
-                theLookahead = EOF;
-                state = tmp_state;
+            if (c == '*' && peek == '/') {
+                *skip = 1;
+                ctx->state = ctx->tmp_state;
             }
             c = 0;
             break;
@@ -215,33 +189,219 @@ static int machine(int c,ngx_buf_t *in)
 }
 
 
+/*
+ * find -- return the first byte before last that is below lo or one of
+ * c1, c2, c3, c4. With SSE2 the bytes are tested 16 at a time.
+ */
+
+static u_char *find(u_char *p, u_char *last, u_char lo, u_char c1, u_char c2,
+    u_char c3, u_char c4)
+{
+#if (__SSE2__)
+    int      mask;
+    __m128i  v, m;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        /* unsigned bytes below lo, compared as signed after flipping */
+
+        m = _mm_cmplt_epi8(_mm_xor_si128(v, _mm_set1_epi8((char) 0x80)),
+                           _mm_set1_epi8((char) (lo ^ 0x80)));
+
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c1)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c2)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c3)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c4)));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+#endif
+
+    while (p < last
+           && *p >= lo && *p != c1 && *p != c2 && *p != c3 && *p != c4)
+    {
+        p++;
+    }
+
+    return p;
+}
+
+
+/*
+ * scan -- find the end of the run of bytes starting at p that the machine
+ * would output unchanged in the current state, whatever follows them: the
+ * structural characters, whitespace, control characters that get() would
+ * translate, and the '/' that may open a comment end the run. A single
+ * space inside a selector or a declaration is kept, so it does not end
+ * the run if the byte after it continues the run. In a comment the run is
+ * every byte but '*' and nothing is output.
+ */
+
+static u_char *scan(ngx_cssmin_t *ctx, u_char *p, u_char *last)
+{
+    u_char  *q;
+
+    switch (ctx->state) {
+
+    case STATE_SELECTOR:
+        for ( ;; ) {
+            q = find(p, last, '!', '{', '@', '/', '/');
+
+            if (last - q < 2 || *q != ' '
+                || find(q + 1, q + 2, '!', '{', '@', '/', '/') != q + 2)
+            {
+                return q;
+            }
+
+            p = q + 2;
+        }
+
+    case STATE_ATRULE:
+        return find(p, last, ' ', '\n', ';', '{', '/');
+
+    case STATE_DECLARATION:
+        if (ctx->in_paren) {
+            return find(p, last, ' ', ')', '/', '/', '/');
+        }
+
+        for ( ;; ) {
+            q = find(p, last, '!', '(', ';', '}', '/');
+
+            if (last - q < 2 || *q != ' '
+                || find(q + 1, q + 2, '!', '(', ';', '}', '/') != q + 2)
+            {
+                return q;
+            }
+
+            p = q + 2;
+        }
+
+    case STATE_COMMENT:
+        q = memchr(p, '*', last - p);
+        return q ? q : last;
+
+    default:
+        return p;
+    }
+}
+
+
+void
+ngx_cssmin_init(ngx_cssmin_t *ctx)
+{
+    ctx->state = STATE_FREE;
+    ctx->tmp_state = STATE_FREE;
+    ctx->in_paren = 0;
+    ctx->pending = EOF;
+    ctx->engine = NGX_CSSMIN_SCAN;
+}
+
 
 /* cssmin -- minify the css
  * removes comments
  * removes newlines and line feeds keeping
  * removes last semicolon from last property
+ *
+ * The machine needs to see one character ahead, so the last character of
+ * every call is kept in ctx->pending until the next input arrives or
+ * the input is over. NGX_AGAIN is returned when out is full.
+ *
+ * With the scan engine the machine only sees the bytes where its state
+ * may change: when the pending character starts a run that scan() accepts,
+ * it is written together with the run, and the byte after the run becomes
+ * the next pending one.
  */
 
-void
-cssmin(ngx_buf_t *in,ngx_buf_t *out)
+ngx_int_t
+cssmin(ngx_cssmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out, ngx_uint_t last)
 {
-    for (;;) {
-        int c = get(in);
-        
-        if (c == EOF) {
-            out->end = out->pos;
-            out->last = out->pos;
-            out->pos = out->start;
-            break;
-        }
-        
-        c = machine(c,in);
+    int          c, peek;
+    u_char      *p, *q, *end, ch;
+    ngx_uint_t   skip;
+
+    if (in) {
+        for (p = in->pos; p < in->last; p++) {
+
+            if (ctx->engine == NGX_CSSMIN_SCAN
+                && ctx->pending != EOF
+                && out->end - out->last > NGX_CSSMIN_RESERVE)
+            {
+                ch = (u_char) ctx->pending;
 
-        if (c != 0) {
-            ngx_putc(c,out);
+                if (scan(ctx, &ch, &ch + 1) == &ch + 1) {
+
+                    end = in->last;
+
+                    if (ctx->state != STATE_COMMENT
+                        && end - p > out->end - out->last - 1)
+                    {
+                        end = p + (out->end - out->last - 1);
+                    }
+
+                    q = scan(ctx, p, end);
+
+                    if (ctx->state != STATE_COMMENT) {
+                        *out->last++ = ch;
+                        out->last = ngx_cpymem(out->last, p, q - p);
+                    }
+
+                    ctx->pending = EOF;
+                    p = q;
+
+                    if (p == in->last) {
+                        break;
+                    }
+                }
+            }
+
+            peek = get(*p);
+
+            if (ctx->pending == EOF) {
+                ctx->pending = peek;
+                continue;
+            }
+
+            if (out->end - out->last < NGX_CSSMIN_RESERVE) {
+                in->pos = p;
+                return NGX_AGAIN;
+            }
+
+            skip = 0;
+            c = machine(ctx, ctx->pending, peek, &skip);
+
+            if (c != 0) {
+                *out->last++ = (u_char) c;
+            }
+
+            ctx->pending = skip ? EOF : peek;
         }
+
+        in->pos = p;
     }
 
-}
+    if (!last || ctx->pending == EOF) {
+        return NGX_OK;
+    }
 
+    if (out->end - out->last < NGX_CSSMIN_RESERVE) {
+        return NGX_AGAIN;
+    }
+
+    skip = 0;
+    c = machine(ctx, ctx->pending, EOF, &skip);
+
+    if (c != 0) {
+        *out->last++ = (u_char) c;
+    }
+
+    ctx->pending = EOF;
 
+    return NGX_OK;
+}
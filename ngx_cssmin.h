@@ -1,3 +1,34 @@
-void cssmin(ngx_buf_t *in,ngx_buf_t *out);
+#ifndef _NGX_CSSMIN_H_INCLUDED_
+#define _NGX_CSSMIN_H_INCLUDED_
 
 
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/* the most bytes cssmin() can write for a single input byte */
+#define NGX_CSSMIN_RESERVE  1
+
+
+/* the machine is run for every byte or only where the state may change */
+#define NGX_CSSMIN_MACHINE  0
+#define NGX_CSSMIN_SCAN     1
+
+
+/* the machine of one stylesheet, initialized by ngx_cssmin_init() */
+
+typedef struct {
+    int          state;
+    int          tmp_state;
+    int          in_paren;
+    int          pending;
+    ngx_uint_t   engine;
+} ngx_cssmin_t;
+
+
+void ngx_cssmin_init(ngx_cssmin_t *ctx);
+ngx_int_t cssmin(ngx_cssmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out,
+    ngx_uint_t last);
+
+
+#endif /* _NGX_CSSMIN_H_INCLUDED_ */
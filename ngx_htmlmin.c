@@ -0,0 +1,828 @@
+/*
+ * Copyright (C) skysbird
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_htmlmin.h"
+
+
+/*
+ * htmlmin is a push parser like jsmin() and cssmin(): it may be called with
+ * any split of the input and keeps everything it needs to resume in
+ * ngx_htmlmin_t. Only the markup is changed:
+ *
+ *   a run of whitespace between text and tags becomes a single space, or
+ *   a linefeed if the run has one, and is removed at the document ends;
+ *   the whitespace inside tags is collapsed outside attribute values;
+ *   comments are removed, except the conditional ones of old browsers;
+ *   the contents of pre and textarea are copied as is;
+ *   the bodies of script and style are minified by jsmin() and cssmin(),
+ *   unless their type is not JavaScript or CSS, then they are copied as is.
+ */
+
+enum {
+    sw_start = 0,
+    sw_text,
+    sw_lt,
+    sw_bang,
+    sw_bang_dash,
+    sw_comment_start,
+    sw_comment,
+    sw_tag_name,
+    sw_tag,
+    sw_attr_name,
+    sw_value_start,
+    sw_value,
+    sw_raw,
+    sw_raw_end,
+    sw_inner,
+    sw_inner_hold,
+    sw_inner_last,
+    sw_inner_close,
+    sw_done
+};
+
+
+/* the elements whose contents are not markup */
+
+#define NGX_HTMLMIN_NONE      0
+#define NGX_HTMLMIN_PRE       1
+#define NGX_HTMLMIN_TEXTAREA  2
+#define NGX_HTMLMIN_SCRIPT    3
+#define NGX_HTMLMIN_STYLE     4
+
+static ngx_str_t  ngx_htmlmin_elements[] = {
+    ngx_null_string,
+    ngx_string("pre"),
+    ngx_string("textarea"),
+    ngx_string("script"),
+    ngx_string("style")
+};
+
+
+#define NGX_HTMLMIN_SPACE  0x01
+#define NGX_HTMLMIN_TEXT   0x02
+#define NGX_HTMLMIN_ALPHA  0x04
+
+static const u_char  ngx_htmlmin_class[256] = {
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 2, 1, 1, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,    /*  !"#$%&'()*+,-./ */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 2, 2, 2,    /* 0123456789:;<=>? */
+    2, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,    /* @ABCDEFGHIJKLMNO */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 2, 2, 2, 2, 2,    /* PQRSTUVWXYZ[\]^_ */
+    2, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,    /* `abcdefghijklmno */
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 2, 2, 2, 2, 2,    /* pqrstuvwxyz{|}~  */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2
+};
+
+#define ngx_htmlmin_is(c, class)  (ngx_htmlmin_class[c] & NGX_HTMLMIN_##class)
+
+
+#define ngx_htmlmin_putc(c, out)  *(out)->last++ = (u_char) (c)
+
+
+static void ngx_htmlmin_flush(ngx_htmlmin_t *ctx, ngx_buf_t *out);
+static void ngx_htmlmin_start_tag(ngx_htmlmin_t *ctx, ngx_buf_t *out,
+    ngx_uint_t closing);
+static void ngx_htmlmin_end_tag(ngx_htmlmin_t *ctx);
+static ngx_uint_t ngx_htmlmin_element(ngx_htmlmin_t *ctx);
+static ngx_uint_t ngx_htmlmin_minified(ngx_htmlmin_t *ctx);
+static ngx_uint_t ngx_htmlmin_close(ngx_htmlmin_t *ctx, u_char c);
+static ngx_int_t ngx_htmlmin_inner(ngx_htmlmin_t *ctx, u_char **pos,
+    u_char *last, ngx_buf_t *out, ngx_uint_t flush);
+
+
+void
+ngx_htmlmin_init(ngx_htmlmin_t *ctx)
+{
+    ngx_memzero(ctx, sizeof(ngx_htmlmin_t));
+
+    ctx->state = sw_start;
+    ctx->css_engine = NGX_CSSMIN_SCAN;
+}
+
+
+/*
+ * The input is consumed from in->pos up to in->last and the output is
+ * appended at out->last. NGX_AGAIN is returned when less than
+ * NGX_HTMLMIN_RESERVE bytes are left in out, the caller should provide
+ * another output buffer and call htmlmin() again with the rest of the
+ * input. If last is set, the end of the input is processed as well.
+ */
+
+ngx_int_t
+htmlmin(ngx_htmlmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out, ngx_uint_t last)
+{
+    u_char     *p, *q, *end, c;
+    size_t      n;
+    ngx_int_t   rc;
+
+    if (in) {
+        p = in->pos;
+        end = in->last;
+
+        while (p < end) {
+
+            if (out->end - out->last < NGX_HTMLMIN_RESERVE) {
+                in->pos = p;
+                return NGX_AGAIN;
+            }
+
+            c = *p;
+
+            switch (ctx->state) {
+
+            case sw_start:
+                if (ngx_htmlmin_is(c, SPACE)) {
+                    p++;
+                    break;
+                }
+
+                ctx->state = sw_text;
+
+                /* fall through */
+
+            case sw_text:
+                if (ngx_htmlmin_is(c, SPACE)) {
+                    if (ctx->space != '\n') {
+                        ctx->space = (c == '\n' || c == '\r') ? '\n' : ' ';
+                    }
+
+                    p++;
+                    break;
+                }
+
+                if (c == '<') {
+                    ctx->hold[0] = c;
+                    ctx->match = 1;
+                    ctx->state = sw_lt;
+                    p++;
+                    break;
+                }
+
+                ngx_htmlmin_flush(ctx, out);
+
+                n = ngx_min(end - p, out->end - out->last);
+
+                for (q = p; q < p + n && ngx_htmlmin_is(*q, TEXT); q++) {
+                    /* void */
+                }
+
+                out->last = ngx_cpymem(out->last, p, q - p);
+                p = q;
+                break;
+
+            case sw_lt:
+                if (c == '!') {
+                    ctx->hold[ctx->match++] = c;
+                    ctx->state = sw_bang;
+                    p++;
+                    break;
+                }
+
+                if (c == '/') {
+                    ngx_htmlmin_start_tag(ctx, out, 1);
+                    ngx_htmlmin_putc(c, out);
+                    ctx->state = sw_tag_name;
+                    p++;
+                    break;
+                }
+
+                if (ngx_htmlmin_is(c, ALPHA)) {
+                    ngx_htmlmin_start_tag(ctx, out, 0);
+                    ctx->state = sw_tag_name;
+                    break;
+                }
+
+                if (c == '?') {
+                    ngx_htmlmin_start_tag(ctx, out, 1);
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                /* a "<" in text */
+
+                ngx_htmlmin_flush(ctx, out);
+                ctx->state = sw_text;
+                break;
+
+            case sw_bang:
+                if (c == '-') {
+                    ctx->hold[ctx->match++] = c;
+                    ctx->state = sw_bang_dash;
+                    p++;
+                    break;
+                }
+
+                /* a declaration like <!DOCTYPE html> */
+
+                ngx_htmlmin_start_tag(ctx, out, 1);
+                ctx->state = sw_tag;
+                break;
+
+            case sw_bang_dash:
+                if (c == '-') {
+                    ctx->match = 0;
+                    ctx->state = sw_comment_start;
+                    p++;
+                    break;
+                }
+
+                ngx_htmlmin_start_tag(ctx, out, 1);
+                ctx->state = sw_tag;
+                break;
+
+            case sw_comment_start:
+                ctx->dashes = 0;
+                ctx->keep = 0;
+                ctx->state = sw_comment;
+
+                /* <!--[if IE]>, <!--<![endif]--> */
+
+                if (c == '[' || c == '<') {
+                    ngx_htmlmin_flush(ctx, out);
+                    out->last = ngx_cpymem(out->last, "<!--", 4);
+                    ctx->keep = 1;
+                    break;
+                }
+
+                /* <!--> and <!---> are complete comments */
+
+                if (c == '>') {
+                    ctx->state = sw_text;
+                    p++;
+                    break;
+                }
+
+                if (c == '-') {
+                    ctx->dashes = 2;
+                    p++;
+                }
+
+                break;
+
+            case sw_comment:
+                if (ctx->keep) {
+                    ngx_htmlmin_putc(c, out);
+                }
+
+                if (c == '-') {
+                    ctx->dashes++;
+
+                } else if (c == '>' && ctx->dashes >= 2) {
+                    ctx->state = sw_text;
+
+                } else {
+                    ctx->dashes = 0;
+
+                    if (!ctx->keep) {
+                        q = ngx_strlchr(p + 1, end, '-');
+                        p = q ? q : end;
+                        break;
+                    }
+                }
+
+                p++;
+                break;
+
+            case sw_tag_name:
+                if (ngx_htmlmin_is(c, SPACE) || c == '/' || c == '>') {
+                    ctx->element = ctx->closing ? NGX_HTMLMIN_NONE
+                                                : ngx_htmlmin_element(ctx);
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if (ctx->name_len < sizeof(ctx->name)) {
+                    ctx->name[ctx->name_len++] = ngx_tolower(c);
+                }
+
+                ngx_htmlmin_putc(c, out);
+                p++;
+                break;
+
+            case sw_tag:
+                if (ngx_htmlmin_is(c, SPACE)) {
+                    ctx->space = ' ';
+                    p++;
+                    break;
+                }
+
+                if (c == '>') {
+                    ctx->space = 0;
+                    ngx_htmlmin_putc(c, out);
+                    ngx_htmlmin_end_tag(ctx);
+                    p++;
+                    break;
+                }
+
+                if (c == '=') {
+                    ctx->space = 0;
+                    ngx_htmlmin_putc(c, out);
+                    ctx->state = sw_value_start;
+                    p++;
+                    break;
+                }
+
+                /* the space of <img src="a" /> is not needed */
+
+                if (c == '/' && !ctx->unquoted) {
+                    ctx->space = 0;
+                }
+
+                ngx_htmlmin_flush(ctx, out);
+                ngx_htmlmin_putc(c, out);
+                p++;
+
+                if (c != '/') {
+                    ctx->name[0] = ngx_tolower(c);
+                    ctx->name_len = 1;
+                    ctx->unquoted = 0;
+                    ctx->state = sw_attr_name;
+                }
+
+                break;
+
+            case sw_attr_name:
+                if (ngx_htmlmin_is(c, SPACE)
+                    || c == '=' || c == '>' || c == '/')
+                {
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if (ctx->name_len < sizeof(ctx->name)) {
+                    ctx->name[ctx->name_len++] = ngx_tolower(c);
+                }
+
+                ngx_htmlmin_putc(c, out);
+                p++;
+                break;
+
+            case sw_value_start:
+                if (ngx_htmlmin_is(c, SPACE)) {
+                    p++;
+                    break;
+                }
+
+                if (c == '>') {
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if ((ctx->element == NGX_HTMLMIN_SCRIPT
+                     || ctx->element == NGX_HTMLMIN_STYLE)
+                    && ctx->name_len == 4
+                    && ngx_strncmp(ctx->name, "type", 4) == 0)
+                {
+                    ctx->typed = 1;
+                    ctx->value_len = 0;
+                }
+
+                if (c == '"' || c == '\'') {
+                    ctx->quote = c;
+                    ctx->unquoted = 0;
+                    ngx_htmlmin_putc(c, out);
+                    p++;
+
+                } else {
+                    ctx->quote = 0;
+                    ctx->unquoted = 1;
+                }
+
+                ctx->state = sw_value;
+                break;
+
+            case sw_value:
+                if (ctx->quote ? c == ctx->quote
+                               : ngx_htmlmin_is(c, SPACE) || c == '>')
+                {
+                    if (ctx->quote) {
+                        ngx_htmlmin_putc(c, out);
+                        p++;
+                    }
+
+                    if (ctx->typed == 1) {
+                        ctx->typed = 2;
+                    }
+
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                n = ngx_min(end - p, out->end - out->last);
+
+                if (ctx->quote) {
+                    q = ngx_strlchr(p, p + n, ctx->quote);
+
+                    if (q == NULL) {
+                        q = p + n;
+                    }
+
+                } else {
+                    for (q = p;
+                         q < p + n && !ngx_htmlmin_is(*q, SPACE) && *q != '>';
+                         q++)
+                    {
+                        /* void */
+                    }
+                }
+
+                if (ctx->typed == 1) {
+                    for ( /* void */ ; p < q; p++) {
+                        if (ctx->value_len < sizeof(ctx->value)) {
+                            ctx->value[ctx->value_len] = ngx_tolower(*p);
+                        }
+
+                        ctx->value_len++;
+                        ngx_htmlmin_putc(*p, out);
+                    }
+
+                    break;
+                }
+
+                out->last = ngx_cpymem(out->last, p, q - p);
+                p = q;
+                break;
+
+            case sw_raw:
+                if (ctx->match == 0 && c != '<') {
+                    n = ngx_min(end - p, out->end - out->last);
+
+                    q = ngx_strlchr(p, p + n, '<');
+
+                    if (q == NULL) {
+                        q = p + n;
+                    }
+
+                    out->last = ngx_cpymem(out->last, p, q - p);
+                    p = q;
+                    break;
+                }
+
+                if (ngx_htmlmin_close(ctx, c)) {
+                    ngx_htmlmin_putc(c, out);
+                    p++;
+
+                    if (++ctx->match
+                        == ngx_htmlmin_elements[ctx->element].len + 2)
+                    {
+                        ctx->state = sw_raw_end;
+                    }
+
+                    break;
+                }
+
+                ctx->match = 0;
+                break;
+
+            case sw_raw_end:
+                ctx->match = 0;
+
+                if (ngx_htmlmin_is(c, SPACE) || c == '/' || c == '>') {
+                    ngx_htmlmin_start_tag(ctx, out, 1);
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                ctx->state = sw_raw;
+                break;
+
+            case sw_inner:
+                if (ctx->match == 0 && c != '<') {
+                    q = ngx_strlchr(p, end, '<');
+
+                    if (q == NULL) {
+                        q = end;
+                    }
+
+                    rc = ngx_htmlmin_inner(ctx, &p, q, out, 0);
+
+                    if (rc == NGX_AGAIN) {
+                        in->pos = p;
+                        return NGX_AGAIN;
+                    }
+
+                    break;
+                }
+
+                /* the end tag is held until it is known to be one */
+
+                if (ctx->match < ngx_htmlmin_elements[ctx->element].len + 2) {
+
+                    if (ngx_htmlmin_close(ctx, c)) {
+                        ctx->hold[ctx->match++] = c;
+                        p++;
+                        break;
+                    }
+
+                } else if (ngx_htmlmin_is(c, SPACE) || c == '/' || c == '>') {
+                    ctx->state = sw_inner_last;
+                    break;
+                }
+
+                ctx->hold_pos = 0;
+                ctx->state = sw_inner_hold;
+                break;
+
+            case sw_inner_hold:
+                q = ctx->hold + ctx->hold_pos;
+
+                rc = ngx_htmlmin_inner(ctx, &q, ctx->hold + ctx->match, out,
+                                       0);
+
+                ctx->hold_pos = q - ctx->hold;
+
+                if (rc == NGX_AGAIN) {
+                    in->pos = p;
+                    return NGX_AGAIN;
+                }
+
+                ctx->match = 0;
+                ctx->state = sw_inner;
+                break;
+
+            case sw_inner_last:
+                rc = ngx_htmlmin_inner(ctx, NULL, NULL, out, 1);
+
+                if (rc == NGX_AGAIN) {
+                    in->pos = p;
+                    return NGX_AGAIN;
+                }
+
+                ctx->state = sw_inner_close;
+                break;
+
+            case sw_inner_close:
+                ngx_htmlmin_start_tag(ctx, out, 1);
+                ctx->state = sw_tag;
+                break;
+
+            default: /* sw_done */
+                p = end;
+                break;
+            }
+        }
+
+        in->pos = p;
+    }
+
+    if (!last) {
+        return NGX_OK;
+    }
+
+    for ( ;; ) {
+
+        if (out->end - out->last < NGX_HTMLMIN_RESERVE) {
+            return NGX_AGAIN;
+        }
+
+        switch (ctx->state) {
+
+        case sw_lt:
+        case sw_bang:
+        case sw_bang_dash:
+            ngx_htmlmin_flush(ctx, out);
+            ctx->state = sw_done;
+            break;
+
+        case sw_inner:
+            ctx->hold_pos = 0;
+            ctx->state = ctx->match ? sw_inner_hold : sw_inner_last;
+            break;
+
+        case sw_inner_hold:
+            q = ctx->hold + ctx->hold_pos;
+
+            rc = ngx_htmlmin_inner(ctx, &q, ctx->hold + ctx->match, out, 0);
+
+            ctx->hold_pos = q - ctx->hold;
+
+            if (rc == NGX_AGAIN) {
+                return NGX_AGAIN;
+            }
+
+            ctx->match = 0;
+            ctx->state = sw_inner_last;
+            break;
+
+        case sw_inner_last:
+            if (ngx_htmlmin_inner(ctx, NULL, NULL, out, 1) == NGX_AGAIN) {
+                return NGX_AGAIN;
+            }
+
+            ctx->state = ctx->match ? sw_inner_close : sw_done;
+            break;
+
+        case sw_inner_close:
+            ngx_htmlmin_start_tag(ctx, out, 1);
+            ctx->state = sw_done;
+            break;
+
+        case sw_done:
+            return NGX_OK;
+
+        default:
+            /* the trailing whitespace is dropped */
+            ctx->state = sw_done;
+            break;
+        }
+    }
+}
+
+
+/* writes the pending space and the held bytes */
+
+static void
+ngx_htmlmin_flush(ngx_htmlmin_t *ctx, ngx_buf_t *out)
+{
+    if (ctx->space) {
+        ngx_htmlmin_putc(ctx->space, out);
+        ctx->space = 0;
+    }
+
+    if (ctx->match) {
+        out->last = ngx_cpymem(out->last, ctx->hold, ctx->match);
+        ctx->match = 0;
+    }
+}
+
+
+static void
+ngx_htmlmin_start_tag(ngx_htmlmin_t *ctx, ngx_buf_t *out, ngx_uint_t closing)
+{
+    ngx_htmlmin_flush(ctx, out);
+
+    ctx->closing = closing;
+    ctx->element = NGX_HTMLMIN_NONE;
+    ctx->typed = 0;
+    ctx->unquoted = 0;
+    ctx->name_len = 0;
+}
+
+
+static void
+ngx_htmlmin_end_tag(ngx_htmlmin_t *ctx)
+{
+    ctx->state = sw_text;
+    ctx->match = 0;
+
+    switch (ctx->element) {
+
+    case NGX_HTMLMIN_PRE:
+    case NGX_HTMLMIN_TEXTAREA:
+        ctx->state = sw_raw;
+        break;
+
+    case NGX_HTMLMIN_SCRIPT:
+        if (!ngx_htmlmin_minified(ctx)) {
+            ctx->state = sw_raw;
+            break;
+        }
+
+        ngx_jsmin_init(&ctx->u.js);
+
+        /* the linefeed jsmin() starts with is not needed after a tag */
+        ctx->lead = 1;
+
+        ctx->state = sw_inner;
+        break;
+
+    case NGX_HTMLMIN_STYLE:
+        if (!ngx_htmlmin_minified(ctx)) {
+            ctx->state = sw_raw;
+            break;
+        }
+
+        ngx_cssmin_init(&ctx->u.css);
+        ctx->u.css.engine = ctx->css_engine;
+
+        ctx->lead = 0;
+        ctx->state = sw_inner;
+        break;
+    }
+}
+
+
+static ngx_uint_t
+ngx_htmlmin_element(ngx_htmlmin_t *ctx)
+{
+    ngx_uint_t  i;
+
+    for (i = 1; i < sizeof(ngx_htmlmin_elements) / sizeof(ngx_str_t); i++) {
+        if (ctx->name_len == ngx_htmlmin_elements[i].len
+            && ngx_strncmp(ctx->name, ngx_htmlmin_elements[i].data,
+                           ctx->name_len)
+               == 0)
+        {
+            return i;
+        }
+    }
+
+    return NGX_HTMLMIN_NONE;
+}
+
+
+/* tests if the type attribute of a script or style names its minifier */
+
+static ngx_uint_t
+ngx_htmlmin_minified(ngx_htmlmin_t *ctx)
+{
+    u_char  *value;
+    size_t   len;
+
+    if (ctx->typed == 0 || ctx->value_len == 0) {
+        return 1;
+    }
+
+    if (ctx->value_len > sizeof(ctx->value)) {
+        return 0;
+    }
+
+    value = ctx->value;
+    len = ctx->value_len;
+
+    if (ctx->element == NGX_HTMLMIN_STYLE) {
+        return len == 8 && ngx_strncmp(value, "text/css", 8) == 0;
+    }
+
+    return (len == 6 && ngx_strncmp(value, "module", 6) == 0)
+           || ngx_strlcasestrn(value, value + len, (u_char *) "javascript",
+                               10 - 1)
+           || ngx_strlcasestrn(value, value + len, (u_char *) "ecmascript",
+                               10 - 1);
+}
+
+
+/* tests if c is the next byte of the end tag of the element */
+
+static ngx_uint_t
+ngx_htmlmin_close(ngx_htmlmin_t *ctx, u_char c)
+{
+    switch (ctx->match) {
+
+    case 0:
+        return c == '<';
+
+    case 1:
+        return c == '/';
+
+    default:
+        return ngx_tolower(c)
+               == ngx_htmlmin_elements[ctx->element].data[ctx->match - 2];
+    }
+}
+
+
+/* minifies the body of a script or a style */
+
+static ngx_int_t
+ngx_htmlmin_inner(ngx_htmlmin_t *ctx, u_char **pos, u_char *last,
+    ngx_buf_t *out, ngx_uint_t flush)
+{
+    u_char     *start;
+    ngx_int_t   rc;
+    ngx_buf_t   in, *b;
+
+    b = NULL;
+
+    if (pos) {
+        in.pos = *pos;
+        in.last = last;
+        b = &in;
+    }
+
+    start = out->last;
+
+    if (ctx->element == NGX_HTMLMIN_SCRIPT) {
+        rc = jsmin(&ctx->u.js, b, out, flush);
+
+    } else {
+        rc = cssmin(&ctx->u.css, b, out, flush);
+    }
+
+    if (pos) {
+        *pos = in.pos;
+    }
+
+    if (ctx->lead && out->last > start) {
+        ctx->lead = 0;
+
+        if (*start == '\n') {
+            ngx_memmove(start, start + 1, out->last - start - 1);
+            out->last--;
+        }
+    }
+
+    return rc;
+}
@@ -0,0 +1,57 @@
+#ifndef _NGX_HTMLMIN_H_INCLUDED_
+#define _NGX_HTMLMIN_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_jsmin.h"
+#include "ngx_cssmin.h"
+
+
+/*
+ * the most bytes htmlmin() can write for a single input byte, it is also
+ * enough for the script and style bodies given to jsmin() and cssmin()
+ */
+#define NGX_HTMLMIN_RESERVE  16
+
+
+/* the machine of one document, initialized by ngx_htmlmin_init() */
+
+typedef struct {
+    ngx_uint_t   state;
+    ngx_uint_t   element;
+    ngx_uint_t   closing;
+    ngx_uint_t   quote;
+    ngx_uint_t   dashes;
+    ngx_uint_t   keep;
+    ngx_uint_t   typed;
+    ngx_uint_t   unquoted;
+    ngx_uint_t   lead;
+    ngx_uint_t   css_engine;
+
+    u_char       space;
+
+    /* the bytes of a tag or an end tag that are not written yet */
+    u_char       hold[16];
+    size_t       match;
+    size_t       hold_pos;
+
+    /* the tag name, the attribute name and the value of "type" */
+    u_char       name[16];
+    size_t       name_len;
+    u_char       value[32];
+    size_t       value_len;
+
+    union {
+        ngx_jsmin_t    js;
+        ngx_cssmin_t   css;
+    } u;
+} ngx_htmlmin_t;
+
+
+void ngx_htmlmin_init(ngx_htmlmin_t *ctx);
+ngx_int_t htmlmin(ngx_htmlmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out,
+    ngx_uint_t last);
+
+
+#endif /* _NGX_HTMLMIN_H_INCLUDED_ */
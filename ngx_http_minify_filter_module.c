@@ -9,21 +9,393 @@
 #include <ngx_http.h>
 #include "ngx_jsmin.h"
 #include "ngx_cssmin.h"
+#include "ngx_htmlmin.h"
+#include "ngx_jsonmin.h"
+#include "ngx_xmlmin.h"
+
+#if (NGX_HTTP_GZIP && NGX_ZLIB)
+#include <zlib.h>
+#endif
+
+
+#define NGX_HTTP_MINIFY_ETAG_LEN         8
+#define NGX_HTTP_MINIFY_CACHE_SIGNATURE  "minify2\n"
+
+
+typedef struct {
+    ngx_path_t          *path;
+    off_t                max_size;
+} ngx_http_minify_cache_path_t;
+
 
 typedef struct {
     ngx_flag_t           enable;
     ngx_hash_t           types;
     ngx_array_t         *types_keys;
+    ngx_bufs_t           bufs;
+    ngx_shm_zone_t      *cache_zone;
+    ngx_http_minify_cache_path_t  *cache_path;
+    ngx_uint_t           static_mode;
+    ngx_flag_t           mmap;
+    size_t               exact_length;
+    off_t                min_length;
+    off_t                max_length;
+    ngx_uint_t           css_engine;
+    ngx_flag_t           cache_gzip;
+    ngx_shm_zone_t      *metrics_zone;
+    ngx_uint_t           metrics_slot;
+    ngx_uint_t           status;
+#if (NGX_THREADS)
+    ngx_thread_pool_t   *thread_pool;
+    size_t               thread_threshold;
+#endif
 } ngx_http_minify_conf_t;
 
 
+typedef struct {
+    ngx_rbtree_t         rbtree;
+    ngx_rbtree_node_t    sentinel;
+    ngx_queue_t          queue;
+} ngx_http_minify_cache_sh_t;
+
+
+typedef struct {
+    ngx_http_minify_cache_sh_t  *sh;
+    ngx_slab_pool_t             *shpool;
+} ngx_http_minify_cache_t;
+
+
+typedef struct {
+    u_char               color;
+    u_char               dummy;
+    u_short              len;
+    ngx_queue_t          queue;
+    ngx_file_uniq_t      uniq;
+    time_t               mtime;
+    off_t                size;
+    u_char               etag[NGX_HTTP_MINIFY_ETAG_LEN];
+    size_t               data_len;
+    size_t               gzip_len;
+    ngx_uint_t           count;
+    unsigned             deleted:1;
+    u_char               data[1];
+} ngx_http_minify_cache_node_t;
+
+
+/* a node sent by a request, released when the request is freed */
+
+typedef struct {
+    ngx_http_minify_cache_t       *cache;
+    ngx_http_minify_cache_node_t  *node;
+} ngx_http_minify_cache_pin_t;
+
+
+typedef struct {
+    ngx_str_t            name;
+    time_t               mtime;
+    off_t                size;
+} ngx_http_minify_cache_file_t;
+
+
+typedef struct {
+    ngx_atomic_t         requests;
+    ngx_atomic_t         bytes_in;
+    ngx_atomic_t         bytes_out;
+    ngx_atomic_t         time;
+} ngx_http_minify_engine_metrics_t;
+
+
+typedef struct {
+    u_char               signature[NGX_HTTP_MINIFY_ETAG_LEN];
+    u_char               etag[NGX_HTTP_MINIFY_ETAG_LEN];
+    off_t                length;
+} ngx_http_minify_cache_header_t;
+
+
+typedef struct {
+    u_char              *addr;
+    size_t               size;
+    ngx_log_t           *log;
+} ngx_http_minify_map_t;
+
+
+typedef struct {
+    ngx_str_t            name;
+    ngx_uint_t           type;
+    char               **keys;
+} ngx_http_minify_engine_t;
+
+
+#define NGX_HTTP_MINIFY_JS         0
+#define NGX_HTTP_MINIFY_CSS        1
+#define NGX_HTTP_MINIFY_HTML       2
+#define NGX_HTTP_MINIFY_JSON       3
+#define NGX_HTTP_MINIFY_XML        4
+#define NGX_HTTP_MINIFY_ENGINES    5
+
+#define NGX_HTTP_MINIFY_READ_SIZE  32768
+#define NGX_HTTP_MINIFY_MAP_SIZE   (1024 * 1024)
+#define NGX_HTTP_MINIFY_MIN_SIZE   256
+#define NGX_HTTP_MINIFY_RESERVE                                               \
+    ngx_max(ngx_max(ngx_max(NGX_JSMIN_RESERVE, NGX_CSSMIN_RESERVE),          \
+                    ngx_max(NGX_HTMLMIN_RESERVE, NGX_JSONMIN_RESERVE)),      \
+            NGX_XMLMIN_RESERVE)
+
+#define NGX_HTTP_MINIFY_THREAD_THRESHOLD  65536
+#define NGX_HTTP_MINIFY_EXACT_LENGTH      65536
+
+#define NGX_HTTP_MINIFY_BUFFERED   0x08
+
+#define NGX_HTTP_MINIFY_STATIC_OFF     0
+#define NGX_HTTP_MINIFY_STATIC_ON      1
+#define NGX_HTTP_MINIFY_STATIC_ALWAYS  2
+
+#define NGX_HTTP_MINIFY_CACHE_KEY_LEN  16
+#define NGX_HTTP_MINIFY_CACHE_MANAGER_SLEEP  10000
+
+#define NGX_HTTP_MINIFY_CACHE_MISS     1
+#define NGX_HTTP_MINIFY_CACHE_HIT      2
+
+#define NGX_HTTP_MINIFY_BYPASS_STATUS       0
+#define NGX_HTTP_MINIFY_BYPASS_ENCODING     1
+#define NGX_HTTP_MINIFY_BYPASS_HEADER_ONLY  2
+#define NGX_HTTP_MINIFY_BYPASS_TYPE         3
+#define NGX_HTTP_MINIFY_BYPASS_LENGTH       4
+#define NGX_HTTP_MINIFY_BYPASS_MINIFIED     5
+#define NGX_HTTP_MINIFY_BYPASS_STATIC       6
+#define NGX_HTTP_MINIFY_BYPASS_REASONS      7
+
+#define NGX_HTTP_MINIFY_STATUS_JSON        1
+#define NGX_HTTP_MINIFY_STATUS_PROMETHEUS  2
+
+/* the size of the status, the names of a location are added to each line */
+#define NGX_HTTP_MINIFY_STATUS_HEADER  2048
+#define NGX_HTTP_MINIFY_STATUS_LINE                                           \
+    (128 + NGX_ATOMIC_T_LEN + NGX_INT_T_LEN)
+#define NGX_HTTP_MINIFY_STATUS_LINES                                          \
+    (4 * NGX_HTTP_MINIFY_ENGINES + 2 + NGX_HTTP_MINIFY_BYPASS_REASONS)
+
+
+/*
+ * the counters of a location, shared by the workers, and its names, which
+ * follow the node in the zone; the index tells apart the locations with
+ * the same names
+ */
+
+typedef struct ngx_http_minify_metrics_node_s  ngx_http_minify_metrics_node_t;
+
+struct ngx_http_minify_metrics_node_s {
+    ngx_http_minify_engine_metrics_t  engines[NGX_HTTP_MINIFY_ENGINES];
+    ngx_atomic_t                      cache_hits;
+    ngx_atomic_t                      cache_misses;
+    ngx_atomic_t                      bypassed[NGX_HTTP_MINIFY_BYPASS_REASONS];
+
+    ngx_http_minify_metrics_node_t   *next;
+    ngx_str_t                         server;
+    ngx_str_t                         location;
+    ngx_uint_t                        index;
+};
+
+
+typedef struct {
+    ngx_http_core_loc_conf_t         *clcf;
+    ngx_str_t                         server;
+    ngx_str_t                         location;
+    ngx_uint_t                        index;
+    ngx_http_minify_metrics_node_t   *node;
+} ngx_http_minify_metrics_loc_t;
+
+
+typedef struct {
+    ngx_array_t                       locations;
+    ngx_slab_pool_t                  *shpool;
+} ngx_http_minify_metrics_t;
+
+
+typedef struct {
+    char                             *name;
+    char                             *help;
+    size_t                            offset;
+} ngx_http_minify_metric_t;
+
+
+typedef struct {
+    ngx_uint_t             type;
+
+    union {
+        ngx_jsmin_t        js;
+        ngx_cssmin_t       css;
+        ngx_htmlmin_t      html;
+        ngx_jsonmin_t      json;
+        ngx_xmlmin_t       xml;
+    } u;
+
+    ngx_chain_t           *in;
+    ngx_buf_t             *readbuf;
+    ngx_buf_t             *map;
+    ngx_http_minify_map_t  mapping;
+    ngx_buf_t             *buf;
+    ngx_chain_t           *out;
+    ngx_chain_t          **last_out;
+
+    ngx_chain_t           *free;
+    ngx_chain_t           *busy;
+    ngx_int_t              bufs;
+
+    ngx_str_t             *cache_name;
+    ngx_open_file_info_t  *cache_of;
+    ngx_chain_t           *cache_out;
+    ngx_chain_t          **cache_last;
+    size_t                 cache_len;
+    ngx_chain_t           *cache_gzip;
+    size_t                 cache_gzip_len;
+    ngx_str_t              cache_file;
+
+    u_char                 etag[NGX_HTTP_MINIFY_ETAG_LEN];
+
+    /* the work of the engine, for the metrics */
+    off_t                  bytes_in;
+    off_t                  bytes_out;
+    uint64_t               time;
+    ngx_uint_t             cache_status;
+
+#if (NGX_THREADS)
+    ngx_thread_task_t     *task;
+#endif
+
+    unsigned               header:1;
+    unsigned               started:1;
+    unsigned               done:1;
+    unsigned               thread_posted:1;
+    unsigned               aio:1;
+    unsigned               hashed:1;
+    unsigned               sibling:1;
+    unsigned               nomem:1;
+    unsigned               gzip:1;
+} ngx_http_minify_ctx_t;
+
+
+#if (NGX_THREADS)
+
+typedef struct {
+    ngx_http_minify_ctx_t *ctx;
+    ngx_buf_t             *buf;
+    ngx_chain_t           *out;
+    ngx_err_t              err;
+    unsigned               failed:1;
+} ngx_http_minify_thread_ctx_t;
+
+#endif
+
+
 static ngx_str_t  ngx_http_minify_default_types[] = {
+    ngx_string("application/javascript"),
     ngx_string("application/x-javascript"),
+    ngx_string("text/javascript"),
     ngx_string("text/css"),
+    ngx_string("image/svg+xml"),
     ngx_null_string
 };
 
 
+/* a MIME type containing one of the keys is minified by the engine */
+
+static char  *ngx_http_minify_js_keys[] = {
+    "javascript", "ecmascript", NULL
+};
+
+static char  *ngx_http_minify_css_keys[] = {
+    "css", NULL
+};
+
+static char  *ngx_http_minify_html_keys[] = {
+    "html", NULL
+};
+
+/* application/json, application/ld+json, but not application/x-ndjson */
+
+static char  *ngx_http_minify_json_keys[] = {
+    "/json", "+json", NULL
+};
+
+static char  *ngx_http_minify_xml_keys[] = {
+    "xml", NULL
+};
+
+
+static ngx_http_minify_engine_t  ngx_http_minify_engines[] = {
+    { ngx_string("js"), NGX_HTTP_MINIFY_JS, ngx_http_minify_js_keys },
+    { ngx_string("css"), NGX_HTTP_MINIFY_CSS, ngx_http_minify_css_keys },
+    { ngx_string("html"), NGX_HTTP_MINIFY_HTML, ngx_http_minify_html_keys },
+    { ngx_string("json"), NGX_HTTP_MINIFY_JSON, ngx_http_minify_json_keys },
+    { ngx_string("xml"), NGX_HTTP_MINIFY_XML, ngx_http_minify_xml_keys },
+    { ngx_null_string, 0, NULL }
+};
+
+
+static ngx_conf_enum_t  ngx_http_minify_static[] = {
+    { ngx_string("off"), NGX_HTTP_MINIFY_STATIC_OFF },
+    { ngx_string("on"), NGX_HTTP_MINIFY_STATIC_ON },
+    { ngx_string("always"), NGX_HTTP_MINIFY_STATIC_ALWAYS },
+    { ngx_null_string, 0 }
+};
+
+
+static ngx_conf_enum_t  ngx_http_minify_css_engines[] = {
+    { ngx_string("machine"), NGX_CSSMIN_MACHINE },
+    { ngx_string("scan"), NGX_CSSMIN_SCAN },
+    { ngx_null_string, 0 }
+};
+
+
+static ngx_str_t  ngx_http_minify_bypass_reasons[] = {
+    ngx_string("status"),
+    ngx_string("encoding"),
+    ngx_string("header_only"),
+    ngx_string("type"),
+    ngx_string("length"),
+    ngx_string("minified"),
+    ngx_string("static")
+};
+
+
+static ngx_http_minify_metric_t  ngx_http_minify_engine_metrics[] = {
+    { "requests_total",
+      "Responses minified by the engine or sent from the minify cache",
+      offsetof(ngx_http_minify_engine_metrics_t, requests) },
+    { "bytes_in_total", "Bytes given to the engine",
+      offsetof(ngx_http_minify_engine_metrics_t, bytes_in) },
+    { "bytes_out_total", "Bytes produced by the engine",
+      offsetof(ngx_http_minify_engine_metrics_t, bytes_out) },
+    { "time_seconds_total", "Time spent in the engine",
+      offsetof(ngx_http_minify_engine_metrics_t, time) },
+    { NULL, NULL, 0 }
+};
+
+
+static ngx_http_minify_metric_t  ngx_http_minify_cache_metrics[] = {
+    { "cache_hits_total", "Responses sent from the minify cache",
+      offsetof(ngx_http_minify_metrics_node_t, cache_hits) },
+    { "cache_misses_total", "Files minified and stored in the minify cache",
+      offsetof(ngx_http_minify_metrics_node_t, cache_misses) },
+    { NULL, NULL, 0 }
+};
+
+
+static char *ngx_http_minify_types(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_minify_cache(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_minify_cache_path(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_minify_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_minify_metrics(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_minify_status(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
 static ngx_command_t  ngx_http_minify_filter_commands[] = {
 
     { ngx_string("minify"),
@@ -36,15 +408,107 @@ static ngx_command_t  ngx_http_minify_filter_commands[] = {
 
     { ngx_string("minify_types"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
-      ngx_http_types_slot,
+      ngx_http_minify_types,
       NGX_HTTP_LOC_CONF_OFFSET,
       offsetof(ngx_http_minify_conf_t, types_keys),
       &ngx_http_minify_default_types[0] },
 
+    { ngx_string("minify_buffers"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE2,
+      ngx_conf_set_bufs_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, bufs),
+      NULL },
+
+    { ngx_string("minify_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_minify_cache,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("minify_cache_path"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_minify_cache_path,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("minify_cache_gzip"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, cache_gzip),
+      NULL },
+
+    { ngx_string("minify_static"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_enum_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, static_mode),
+      &ngx_http_minify_static },
+
+    { ngx_string("minify_exact_length"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_size_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, exact_length),
+      NULL },
+
+    { ngx_string("minify_min_length"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_off_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, min_length),
+      NULL },
+
+    { ngx_string("minify_max_length"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_off_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, max_length),
+      NULL },
+
+    { ngx_string("minify_mmap"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, mmap),
+      NULL },
+
+    { ngx_string("minify_css_engine"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_enum_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_minify_conf_t, css_engine),
+      &ngx_http_minify_css_engines },
+
+    { ngx_string("minify_thread_pool"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE12,
+      ngx_http_minify_thread_pool,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("minify_metrics"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_minify_metrics,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("minify_status"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS|NGX_CONF_TAKE1,
+      ngx_http_minify_status,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
 
+static ngx_int_t ngx_http_minify_add_variables(ngx_conf_t *cf);
 static ngx_int_t ngx_http_minify_filter_init(ngx_conf_t *cf);
 static void *ngx_http_minify_create_conf(ngx_conf_t *cf);
 static char *ngx_http_minify_merge_conf(ngx_conf_t *cf, void *parent, 
@@ -52,7 +516,7 @@ static char *ngx_http_minify_merge_conf(ngx_conf_t *cf, void *parent,
 
 
 static ngx_http_module_t  ngx_http_minify_filter_module_ctx = {
-    NULL,                                    /* preconfiguration */
+    ngx_http_minify_add_variables,           /* preconfiguration */
     ngx_http_minify_filter_init,             /* postconfiguration */
 
     NULL,                                    /* create main configuration */
@@ -82,336 +546,4422 @@ ngx_module_t  ngx_http_minify_filter_module = {
 };
 
 
+static ngx_int_t ngx_http_minify_bytes_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_minify_ratio_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_minify_time_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+static ngx_int_t ngx_http_minify_cache_status_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data);
+
+
+static ngx_http_variable_t  ngx_http_minify_vars[] = {
+
+    { ngx_string("minify_bytes_in"), NULL, ngx_http_minify_bytes_variable,
+      offsetof(ngx_http_minify_ctx_t, bytes_in), NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("minify_bytes_out"), NULL, ngx_http_minify_bytes_variable,
+      offsetof(ngx_http_minify_ctx_t, bytes_out), NGX_HTTP_VAR_NOCACHEABLE,
+      0 },
+
+    { ngx_string("minify_ratio"), NULL, ngx_http_minify_ratio_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("minify_time_us"), NULL, ngx_http_minify_time_variable,
+      0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_string("minify_cache_status"), NULL,
+      ngx_http_minify_cache_status_variable, 0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+
+    { ngx_null_string, NULL, NULL, 0, 0, 0 }
+};
+
+
 static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
 static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
-static ngx_int_t ngx_http_minify_buf(ngx_buf_t *buf,ngx_http_request_t *r,
-    ngx_open_file_info_t *of);
+static ngx_http_minify_engine_t *ngx_http_minify_engine(
+    ngx_http_request_t *r, ngx_http_minify_conf_t *conf);
+static ngx_http_minify_engine_t *ngx_http_minify_find_engine(u_char *type,
+    size_t len);
+static ngx_int_t ngx_http_minify_send_header(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx);
+static ngx_int_t ngx_http_minify_not_modified(ngx_http_request_t *r,
+    ngx_http_minify_conf_t *conf);
+static ngx_int_t ngx_http_minify_set_etag(ngx_http_request_t *r,
+    u_char *hash);
+static ngx_int_t ngx_http_minify_set_gzip(ngx_http_request_t *r);
+static ngx_uint_t ngx_http_minify_test_etag(ngx_http_request_t *r);
+static ngx_int_t ngx_http_minify_send_not_modified(ngx_http_request_t *r);
+static ngx_int_t ngx_http_minify_static_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_minify_file(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static ngx_int_t ngx_http_minify_map_file(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static void ngx_http_minify_unmap_file(void *data);
+static ssize_t ngx_http_minify_read_file(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b, u_char *buf, size_t size);
+#if (NGX_HAVE_FILE_AIO)
+static void ngx_http_minify_aio_event_handler(ngx_event_t *ev);
+#endif
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_minify_thread_read_handler(ngx_thread_task_t *task,
+    ngx_file_t *file);
+static void ngx_http_minify_thread_read_event_handler(ngx_event_t *ev);
+#endif
+static void ngx_http_minify_aio_done(ngx_http_request_t *r);
+static ngx_int_t ngx_http_minify_memory(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static ngx_int_t ngx_http_minify_special(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static ngx_int_t ngx_http_minify_process(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *in, ngx_uint_t last);
+static ngx_int_t ngx_http_minify_get_buf(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx);
+static ngx_int_t ngx_http_minify_run(ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *in, ngx_buf_t *out, ngx_uint_t last);
+static ngx_int_t ngx_http_minify_flush_buf(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx);
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_minify_thread_post(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static void ngx_http_minify_thread_handler(void *data, ngx_log_t *log);
+static void ngx_http_minify_thread_event_handler(ngx_event_t *ev);
+static ngx_int_t ngx_http_minify_thread_done(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx);
+#endif
+static ngx_int_t ngx_http_minify_cache_open(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static ngx_int_t ngx_http_minify_cache_collect(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b);
+static ngx_int_t ngx_http_minify_cache_file_open(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_str_t *name, ngx_open_file_info_t *sof,
+    ngx_uint_t *gzip);
+static ngx_int_t ngx_http_minify_cache_file_name(ngx_http_request_t *r,
+    ngx_str_t *name, ngx_open_file_info_t *sof, ngx_str_t *file);
+static ngx_int_t ngx_http_minify_cache_file_read(ngx_http_request_t *r,
+    ngx_str_t *file, ngx_open_file_info_t *of, u_char *etag, off_t *length);
+static void ngx_http_minify_cache_file_write(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx);
+#if (NGX_HTTP_GZIP && NGX_ZLIB)
+static void ngx_http_minify_cache_gzip(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx);
+#endif
+static ngx_msec_t ngx_http_minify_cache_manager(void *data);
+static ngx_int_t ngx_http_minify_cache_manage_file(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static ngx_int_t ngx_http_minify_cache_noop(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static ngx_int_t ngx_http_minify_cache_cmp_files(const void *one,
+    const void *two);
+static ngx_int_t ngx_http_minify_cache_lookup(ngx_http_request_t *r,
+    ngx_shm_zone_t *zone, ngx_str_t *name, ngx_open_file_info_t *of,
+    ngx_buf_t *buf, u_char *etag, ngx_uint_t *gzip, off_t *length);
+static void ngx_http_minify_cache_unpin(void *data);
+static void ngx_http_minify_cache_store(ngx_http_request_t *r,
+    ngx_shm_zone_t *zone, ngx_str_t *name, ngx_open_file_info_t *of,
+    ngx_http_minify_ctx_t *ctx);
+static ngx_int_t ngx_http_minify_bypass(ngx_http_request_t *r,
+    ngx_http_minify_conf_t *conf, ngx_uint_t reason);
+static ngx_uint_t ngx_http_minify_minified(ngx_http_request_t *r);
+static uint64_t ngx_http_minify_time(void);
+static ngx_int_t ngx_http_minify_log_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_minify_metrics_slot(ngx_conf_t *cf,
+    ngx_http_minify_conf_t *prev, ngx_http_minify_conf_t *conf);
+static ngx_int_t ngx_http_minify_metrics_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_int_t ngx_http_minify_status_handler(ngx_http_request_t *r);
+static ngx_http_minify_metrics_node_t *ngx_http_minify_metrics_node(
+    ngx_http_minify_conf_t *conf);
+static u_char *ngx_http_minify_status_json(u_char *p, ngx_shm_zone_t *zone);
+static u_char *ngx_http_minify_status_prometheus(u_char *p,
+    ngx_shm_zone_t *zone);
+static u_char *ngx_http_minify_status_labels(u_char *p, char *name,
+    ngx_http_minify_metrics_loc_t *loc);
+static u_char *ngx_http_minify_escape(u_char *dst, ngx_str_t *src);
 
 
 static ngx_int_t
 ngx_http_minify_header_filter(ngx_http_request_t *r)
 {
-    ngx_http_minify_conf_t  *conf;
+    ngx_int_t                  rc;
+    ngx_http_minify_ctx_t     *ctx;
+    ngx_http_minify_conf_t    *conf;
+    ngx_http_minify_engine_t  *engine;
 
     conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
 
     if (!conf->enable
-        || (r->headers_out.status != NGX_HTTP_OK
-            && r->headers_out.status != NGX_HTTP_FORBIDDEN
-            && r->headers_out.status != NGX_HTTP_NOT_FOUND)
-        || (r->headers_out.content_encoding
-            && r->headers_out.content_encoding->value.len)
-        || ngx_http_test_content_type(r, &conf->types) == NULL
-        || r->header_only)
+        || ngx_http_get_module_ctx(r, ngx_http_minify_filter_module))
     {
         return ngx_http_next_header_filter(r);
     }
 
-    ngx_http_clear_content_length(r);
-    return ngx_http_next_header_filter(r);
-}
-
-static ngx_int_t ngx_http_minify_buf_in_memory(ngx_buf_t *buf,ngx_http_request_t *r);
-
-static ngx_int_t
-ngx_http_minify_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
-{
-    ngx_buf_t                  *b;
-    ngx_int_t                   rc;
-    ngx_str_t                  *filename;
-    ngx_uint_t                  level;
-    ngx_chain_t                *cl;
-    ngx_open_file_info_t        of;
-    ngx_http_minify_conf_t     *conf;
-    ngx_http_core_loc_conf_t   *ccf;
-
-    ccf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
-    conf = ngx_http_get_module_loc_conf(r,ngx_http_minify_filter_module);
-    if (!conf->enable){
-        return ngx_http_next_body_filter(r,in);
+    if (r->headers_out.status != NGX_HTTP_OK
+        && r->headers_out.status != NGX_HTTP_FORBIDDEN
+        && r->headers_out.status != NGX_HTTP_NOT_FOUND)
+    {
+        return ngx_http_minify_bypass(r, conf, NGX_HTTP_MINIFY_BYPASS_STATUS);
     }
 
-    if(ngx_http_test_content_type(r, &conf->types) == NULL){
-        return ngx_http_next_body_filter(r,in);
+    if (r->headers_out.content_encoding
+        && r->headers_out.content_encoding->value.len)
+    {
+        return ngx_http_minify_bypass(r, conf,
+                                      NGX_HTTP_MINIFY_BYPASS_ENCODING);
     }
 
-    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                   "http minify filter");
+    if (r->header_only) {
+        return ngx_http_minify_bypass(r, conf,
+                                      NGX_HTTP_MINIFY_BYPASS_HEADER_ONLY);
+    }
 
-    for (cl = in; cl; cl = cl->next) {
-        b = cl->buf;
+    engine = ngx_http_minify_engine(r, conf);
 
-        if (cl->buf->in_file){
-            ngx_memzero(&of, sizeof(ngx_open_file_info_t));
+    if (engine == NULL) {
+        /* no minifier for this type */
+        return ngx_http_minify_bypass(r, conf, NGX_HTTP_MINIFY_BYPASS_TYPE);
+    }
 
-            of.read_ahead = ccf->read_ahead;
-            of.directio = ccf->directio;
-            of.valid = ccf->open_file_cache_valid;
-            of.min_uses = ccf->open_file_cache_min_uses;
-            of.errors = ccf->open_file_cache_errors;
-            of.events = ccf->open_file_cache_events;
+    if (ngx_http_minify_minified(r)) {
+        return ngx_http_minify_bypass(r, conf,
+                                      NGX_HTTP_MINIFY_BYPASS_MINIFIED);
+    }
 
-            filename = &cl->buf->file->name;
-            if (ngx_open_cached_file(ccf->open_file_cache, filename, &of, r->pool)
-                    != NGX_OK)
-                {
-                    switch (of.err) {
+    /* for a file the length is the size of the file */
 
-                    case 0:
-                        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if (r->headers_out.content_length_n >= 0
+        && (r->headers_out.content_length_n < conf->min_length
+            || (conf->max_length
+                && r->headers_out.content_length_n > conf->max_length)))
+    {
+        return ngx_http_minify_bypass(r, conf, NGX_HTTP_MINIFY_BYPASS_LENGTH);
+    }
 
-                    case NGX_ENOENT:
-                    case NGX_ENOTDIR:
-                    case NGX_ENAMETOOLONG:
+    if (r->headers_in.if_none_match
+        && r->headers_out.etag
+        && r->headers_out.status == NGX_HTTP_OK
+        && (conf->cache_zone || conf->cache_path))
+    {
+        rc = ngx_http_minify_not_modified(r, conf);
 
-                        level = NGX_LOG_ERR;
-                        rc = NGX_HTTP_NOT_FOUND;
-                        break;
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
 
-                    case NGX_EACCES:
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_minify_ctx_t));
+    if (ctx == NULL) {
+        return NGX_ERROR;
+    }
 
-                        level = NGX_LOG_ERR;
-                        rc = NGX_HTTP_FORBIDDEN;
-                        break;
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     ctx->buf = NULL;
+     *     ctx->out = NULL;
+     *     ctx->header = 0;
+     *     ctx->started = 0;
+     *     ctx->done = 0;
+     */
 
-                    default:
+    ctx->type = engine->type;
+    ctx->last_out = &ctx->out;
 
-                        level = NGX_LOG_CRIT;
-                        rc = NGX_HTTP_INTERNAL_SERVER_ERROR;
-                        break;
-                    }
+    switch (ctx->type) {
 
-                    if (rc != NGX_HTTP_NOT_FOUND || ccf->log_not_found) {
-                        ngx_log_error(level, r->connection->log, of.err,
-                                      "%s \"%V\" failed", of.failed, filename);
-                    }
+    case NGX_HTTP_MINIFY_JS:
+        ngx_jsmin_init(&ctx->u.js);
+        break;
 
+    case NGX_HTTP_MINIFY_CSS:
+        ngx_cssmin_init(&ctx->u.css);
+        ctx->u.css.engine = conf->css_engine;
+        break;
 
-                    return rc;
-                }
+    case NGX_HTTP_MINIFY_HTML:
+        ngx_htmlmin_init(&ctx->u.html);
+        ctx->u.html.css_engine = conf->css_engine;
+        break;
 
-            if (!of.is_file) {
-                ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
-                              "\"%V\" is not a regular file", filename);
-                return NGX_HTTP_NOT_FOUND;
-            }
+    case NGX_HTTP_MINIFY_JSON:
+        ngx_jsonmin_init(&ctx->u.json);
+        break;
 
-            if (of.size == 0) {
-                continue;
-            }
+    default: /* NGX_HTTP_MINIFY_XML */
+        ngx_xmlmin_init(&ctx->u.xml);
+        break;
+    }
 
-            ngx_http_minify_buf(b,r,&of);    
+    ngx_http_set_ctx(r, ctx, ngx_http_minify_filter_module);
 
-        } else {
+    /* ranges would be cut from the original body */
 
-           if (b->pos == NULL) {
-                continue;
-           }
+    ngx_http_clear_accept_ranges(r);
 
-           ngx_http_minify_buf_in_memory(b,r); 
-        }
+    if (r->headers_out.content_length_n >= 0
+        && r->headers_out.content_length_n <= (off_t) conf->exact_length)
+    {
+        /*
+         * a small enough body is minified completely before the header
+         * is sent, so that the header tells the minified length
+         */
 
+        ctx->header = 1;
+        return NGX_OK;
     }
 
-    return ngx_http_next_body_filter(r,in);
+    ngx_http_clear_content_length(r);
+    ngx_http_weak_etag(r);
 
+    return ngx_http_next_header_filter(r);
 }
 
-static ngx_int_t 
-ngx_http_minify_buf_in_memory(ngx_buf_t *buf,ngx_http_request_t *r)
+
+static ngx_int_t
+ngx_http_minify_bypass(ngx_http_request_t *r, ngx_http_minify_conf_t *conf,
+    ngx_uint_t reason)
 {
-    ngx_buf_t   *b = NULL, *dst = NULL, *min_dst = NULL;
-    ngx_int_t size;
+    ngx_http_minify_metrics_node_t  *node;
 
-    size = buf->end - buf->start;
+    node = ngx_http_minify_metrics_node(conf);
 
-    dst = buf;
-    dst->end[0] = 0;
-    
-    b = ngx_calloc_buf(r->pool); 
-    if (b == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if (node) {
+        (void) ngx_atomic_fetch_add(&node->bypassed[reason], 1);
     }
-    
-    b->start = ngx_palloc(r->pool, size);
-    b->pos = b->start;
-    b->last = b->start;
-    b->end = b->last + size;
-    b->temporary = 1;
-    
-    min_dst = b;
-    if (ngx_strcmp(r->headers_out.content_type.data,
-                   ngx_http_minify_default_types[0].data) 
-        == 0)
-    {
-        jsmin(dst,min_dst);
 
-    } else if (ngx_strcmp(r->headers_out.content_type.data, 
-                          ngx_http_minify_default_types[1].data) 
-               == 0)
-    {
-        cssmin(dst,min_dst);
+    return ngx_http_next_header_filter(r);
+}
 
-    } else {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+/* "foo.min.js" and "foo.min.css" were minified when they were built */
+
+static ngx_uint_t
+ngx_http_minify_minified(ngx_http_request_t *r)
+{
+    size_t  len;
+
+    if (r->exten.len == 0) {
+        return 0;
     }
 
-    buf->start = min_dst->start;     
-    buf->pos = min_dst->pos;
-    buf->last = min_dst->last;
-    buf->end = min_dst->end;
-    buf->memory = 1;
-    buf->in_file = 0;
-    
+    len = r->exten.len + sizeof(".min.") - 1;
 
-    return NGX_OK;
+    if (r->uri.len <= len) {
+        return 0;
+    }
 
+    return ngx_strncasecmp(r->uri.data + r->uri.len - len,
+                           (u_char *) ".min.", sizeof(".min.") - 1)
+           == 0;
 }
 
-static ngx_int_t 
-ngx_http_minify_buf(ngx_buf_t *buf,ngx_http_request_t *r,
-                    ngx_open_file_info_t *of)
+
+/*
+ * The engine of a MIME type is the value of minify_types in the types hash,
+ * so it is found with a single lookup. The default types and "*" have no
+ * engine of their own: it is derived from the name of the type.
+ */
+
+static ngx_http_minify_engine_t *
+ngx_http_minify_engine(ngx_http_request_t *r, ngx_http_minify_conf_t *conf)
 {
-    ngx_buf_t   *b = NULL, *dst = NULL, *min_dst = NULL;
-    ngx_int_t    size;
-    ngx_file_t  *src_file ;
-    ssize_t n;
+    ngx_http_minify_engine_t  *engine;
 
-    src_file =  ngx_pcalloc(r->pool, sizeof(ngx_file_t));
-    if (src_file == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    engine = ngx_http_test_content_type(r, &conf->types);
+
+    if (engine == (void *) 4) {
+        engine = ngx_http_minify_find_engine(r->headers_out.content_type.data,
+                                             r->headers_out.content_type_len);
     }
 
-    src_file->fd = of->fd;
-    src_file->name = buf->file->name;
-    src_file->log = r->connection->log;
-    src_file->directio = of->is_directio;
+    return engine;
+}
 
-    size = of->size;
 
-    b = ngx_calloc_buf(r->pool); 
-    if (b == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
-    }
+static ngx_http_minify_engine_t *
+ngx_http_minify_find_engine(u_char *type, size_t len)
+{
+    char                      **key;
+    ngx_http_minify_engine_t   *engine;
 
-    b->start = ngx_palloc(r->pool, size+1);
-    b->pos = b->start;
-    b->last = b->start;
-    b->end = b->last + size ;
-    b->temporary = 1;
-
-    dst = b;
-
-    #if (NGX_HAVE_FILE_AIO)
-    
-         ngx_output_chain_ctx_t       *ctx;
-         ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
-         if (ctx->aio_handler) {
-             n = ngx_file_aio_read(src_file, dst->pos, (size_t) size, 0, 
-                                   ctx->pool);
-
-             if (n == NGX_AGAIN) {
-             ctx->aio_handler(ctx, src_file);
-             return NGX_AGAIN;
-             }
-    
-         } else {
-             n = ngx_read_file(src_file, dst->pos, (size_t) size, 0);
-         }
-    #else
-    
-        ngx_read_file(src_file, dst->pos, (size_t) size, 0);
-    #endif
-
-    dst->end[0] = 0;
-    
-    b = ngx_calloc_buf(r->pool); 
-    if (b == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    for (engine = ngx_http_minify_engines; engine->name.len; engine++) {
+        for (key = engine->keys; *key; key++) {
+            if (ngx_strlcasestrn(type, type + len, (u_char *) *key,
+                                 ngx_strlen(*key) - 1)
+                != NULL)
+            {
+                return engine;
+            }
+        }
     }
-    
-    b->start = ngx_palloc(r->pool, size);
-    b->pos = b->start;
-    b->last = b->start;
-    b->end = b->last + size;
-    b->temporary = 1;
-    
-    min_dst = b;
-    if (ngx_strcmp(r->headers_out.content_type.data,
-                   ngx_http_minify_default_types[0].data) 
-        == 0)
-    {
-        jsmin(dst,min_dst);
 
-    } else if (ngx_strcmp(r->headers_out.content_type.data, 
-                          ngx_http_minify_default_types[1].data) 
-               == 0)
-    {
-        cssmin(dst,min_dst);
+    return NULL;
+}
 
-    } else {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
-    }
 
-    buf->start = min_dst->start;     
-    buf->pos = min_dst->pos;
-    buf->last = min_dst->last;
-    buf->end = min_dst->end;
-    buf->memory = 1;
-    buf->in_file = 0;
-    
+static ngx_int_t
+ngx_http_minify_send_header(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx)
+{
+    off_t         len;
+    ngx_md5_t     md5;
+    ngx_chain_t  *cl;
+    u_char        hash[16];
 
-    return NGX_OK;
+    len = 0;
 
-}
+    ngx_md5_init(&md5);
 
-static void *
-ngx_http_minify_create_conf(ngx_conf_t *cf)
-{
-    ngx_http_minify_conf_t  *conf;
+    for (cl = ctx->out; cl; cl = cl->next) {
+        len += ngx_buf_size(cl->buf);
+
+        /* a cache hit, possibly from a file, comes with its hash */
+
+        if (!ctx->hashed && ngx_buf_in_memory(cl->buf)) {
+            ngx_md5_update(&md5, cl->buf->pos, cl->buf->last - cl->buf->pos);
+        }
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify length: %O", len);
+
+    ngx_http_clear_content_length(r);
+
+    r->headers_out.content_length_n = len;
+
+    if (ctx->gzip && ngx_http_minify_set_gzip(r) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (r->headers_out.etag == NULL) {
+        return ngx_http_next_header_filter(r);
+    }
+
+    if (!ctx->hashed) {
+        ngx_md5_final(hash, &md5);
+        ngx_memcpy(ctx->etag, hash, NGX_HTTP_MINIFY_ETAG_LEN);
+        ctx->hashed = 1;
+    }
+
+    if (ngx_http_minify_set_etag(r, ctx->etag) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (r->headers_in.if_none_match && ngx_http_minify_test_etag(r)) {
+        return ngx_http_minify_send_not_modified(r);
+    }
+
+    if (ctx->gzip) {
+        /* the same as the gzip filter does for the compressed content */
+        ngx_http_weak_etag(r);
+    }
+
+    return ngx_http_next_header_filter(r);
+}
+
+
+/*
+ * A conditional request for a file whose minified content is in the minify
+ * cache is answered before the file is read: the ETag of the minified
+ * content is stored with it.
+ */
+
+static ngx_int_t
+ngx_http_minify_not_modified(ngx_http_request_t *r,
+    ngx_http_minify_conf_t *conf)
+{
+    u_char                     *last;
+    off_t                       length;
+    size_t                      root;
+    ngx_int_t                   rc;
+    ngx_str_t                   path, file;
+    ngx_table_elt_t            *etag;
+    ngx_open_file_info_t        of, cof;
+    ngx_http_core_loc_conf_t        *ccf;
+    ngx_http_minify_metrics_node_t  *node;
+    u_char                           hash[NGX_HTTP_MINIFY_ETAG_LEN];
+    u_char                      value[NGX_OFF_T_LEN + NGX_TIME_T_LEN + 3];
+
+    if (r->headers_out.last_modified_time == -1
+        || r->headers_out.content_length_n < 0)
+    {
+        return NGX_DECLINED;
+    }
+
+    /* only a file sent by the static module is looked up */
+
+    etag = r->headers_out.etag;
+
+    last = ngx_sprintf(value, "\"%xT-%xO\"",
+                       r->headers_out.last_modified_time,
+                       r->headers_out.content_length_n);
+
+    if (etag->value.len != (size_t) (last - value)
+        || ngx_strncmp(etag->value.data, value, last - value) != 0)
+    {
+        return NGX_DECLINED;
+    }
+
+    last = ngx_http_map_uri_to_path(r, &path, &root, 0);
+    if (last == NULL) {
+        return NGX_ERROR;
+    }
+
+    path.len = last - path.data;
+
+    ccf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    ngx_memzero(&of, sizeof(ngx_open_file_info_t));
+
+    of.test_only = 1;
+    of.valid = ccf->open_file_cache_valid;
+    of.min_uses = ccf->open_file_cache_min_uses;
+    of.errors = ccf->open_file_cache_errors;
+    of.events = ccf->open_file_cache_events;
+
+    if (ngx_open_cached_file(ccf->open_file_cache, &path, &of, r->pool)
+        != NGX_OK)
+    {
+        return NGX_DECLINED;
+    }
+
+    if (!of.is_file
+        || of.mtime != r->headers_out.last_modified_time
+        || of.size != r->headers_out.content_length_n)
+    {
+        return NGX_DECLINED;
+    }
+
+    rc = NGX_DECLINED;
+
+    if (conf->cache_zone) {
+        rc = ngx_http_minify_cache_lookup(r, conf->cache_zone, &path, &of,
+                                          NULL, hash, NULL, NULL);
+    }
+
+    if (rc == NGX_DECLINED && conf->cache_path) {
+        if (ngx_http_minify_cache_file_name(r, &path, &of, &file) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(&cof, sizeof(ngx_open_file_info_t));
+
+        rc = ngx_http_minify_cache_file_read(r, &file, &cof, hash, &length);
+    }
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    if (ngx_http_minify_set_etag(r, hash) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (!ngx_http_minify_test_etag(r)) {
+        /* the body is minified as usual, the ETag is already known */
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify not modified: \"%V\"", &path);
+
+    node = ngx_http_minify_metrics_node(conf);
+
+    if (node) {
+        (void) ngx_atomic_fetch_add(&node->cache_hits, 1);
+    }
+
+    return ngx_http_minify_send_not_modified(r);
+}
+
+
+static ngx_int_t
+ngx_http_minify_set_etag(ngx_http_request_t *r, u_char *hash)
+{
+    u_char           *p;
+    ngx_table_elt_t  *etag;
+
+    etag = r->headers_out.etag;
+
+    p = ngx_pnalloc(r->pool, 2 * NGX_HTTP_MINIFY_ETAG_LEN + 2);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    etag->value.data = p;
+
+    *p++ = '"';
+    p = ngx_hex_dump(p, hash, NGX_HTTP_MINIFY_ETAG_LEN);
+    *p++ = '"';
+
+    etag->value.len = p - etag->value.data;
+
+    return NGX_OK;
+}
+
+
+/*
+ * A gzip variant from the minify cache is sent as gzip_static sends files.
+ * It always gets "Vary: Accept-Encoding", so that a shared cache does not
+ * hand it to clients without gzip; with gzip_vary on the header filter
+ * adds it already.
+ */
+
+static ngx_int_t
+ngx_http_minify_set_gzip(ngx_http_request_t *r)
+{
+    ngx_table_elt_t           *h;
+#if (NGX_HTTP_GZIP)
+    ngx_http_core_loc_conf_t  *clcf;
+#endif
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    h->hash = 1;
+#if (nginx_version >= 1023000)
+    h->next = NULL;
+#endif
+    ngx_str_set(&h->key, "Content-Encoding");
+    ngx_str_set(&h->value, "gzip");
+    r->headers_out.content_encoding = h;
+
+#if (NGX_HTTP_GZIP)
+
+    r->gzip_vary = 1;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    if (clcf->gzip_vary) {
+        return NGX_OK;
+    }
+
+    h = ngx_list_push(&r->headers_out.headers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    h->hash = 1;
+#if (nginx_version >= 1023000)
+    h->next = NULL;
+#endif
+    ngx_str_set(&h->key, "Vary");
+    ngx_str_set(&h->value, "Accept-Encoding");
+
+#endif
+
+    return NGX_OK;
+}
+
+
+/* the weak comparison of ngx_http_test_if_match() */
+
+static ngx_uint_t
+ngx_http_minify_test_etag(ngx_http_request_t *r)
+{
+    u_char     *start, *end, ch;
+    ngx_str_t  *etag, *header;
+
+    etag = &r->headers_out.etag->value;
+    header = &r->headers_in.if_none_match->value;
+
+    if (header->len == 1 && header->data[0] == '*') {
+        return 1;
+    }
+
+    start = header->data;
+    end = header->data + header->len;
+
+    while (start < end) {
+
+        if (end - start > 2 && start[0] == 'W' && start[1] == '/') {
+            start += 2;
+        }
+
+        if (etag->len > (size_t) (end - start)) {
+            return 0;
+        }
+
+        if (ngx_strncmp(start, etag->data, etag->len) != 0) {
+            goto skip;
+        }
+
+        start += etag->len;
+
+        while (start < end) {
+            ch = *start;
+
+            if (ch == ' ' || ch == '\t') {
+                start++;
+                continue;
+            }
+
+            break;
+        }
+
+        if (start == end || *start == ',') {
+            return 1;
+        }
+
+    skip:
+
+        while (start < end && *start != ',') { start++; }
+        while (start < end) {
+            ch = *start;
+
+            if (ch == ' ' || ch == '\t' || ch == ',') {
+                start++;
+                continue;
+            }
+
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+static ngx_int_t
+ngx_http_minify_send_not_modified(ngx_http_request_t *r)
+{
+    r->headers_out.status = NGX_HTTP_NOT_MODIFIED;
+    r->headers_out.status_line.len = 0;
+    r->headers_out.content_type.len = 0;
+
+    ngx_http_clear_content_length(r);
+    ngx_http_clear_accept_ranges(r);
+
+    if (r->headers_out.content_encoding) {
+        r->headers_out.content_encoding->hash = 0;
+        r->headers_out.content_encoding = NULL;
+    }
+
+    return ngx_http_next_header_filter(r);
+}
+
+
+/*
+ * The body is minified as it flows through the filter: every buffer is fed
+ * to the minifier, which keeps its state in the request context between
+ * the buffers, and the output produced so far is passed on at once.
+ *
+ * Input that cannot be handled right away, because a large buffer is being
+ * minified in a thread pool, waits in ctx->in until the task is done.
+ */
+
+static ngx_int_t
+ngx_http_minify_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    ngx_int_t               rc;
+    ngx_buf_t              *b;
+    ngx_chain_t            *out;
+    ngx_http_minify_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    if (ctx == NULL || ctx->done) {
+        return ngx_http_next_body_filter(r, in);
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify filter");
+
+    if (in && ngx_chain_add_copy(r->pool, &ctx->in, in) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (ctx->aio) {
+        /* a file read or a minify task is in progress */
+        return NGX_AGAIN;
+    }
+
+#if (NGX_THREADS)
+
+    if (ctx->thread_posted
+        && ngx_http_minify_thread_done(r, ctx) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+#endif
+
+    for ( ;; ) {
+
+        while (ctx->in) {
+            b = ctx->in->buf;
+
+            if (b->in_file && !ngx_buf_in_memory(b)) {
+                rc = ngx_http_minify_file(r, ctx, b);
+
+            } else if (ngx_buf_size(b)) {
+                rc = ngx_http_minify_memory(r, ctx, b);
+
+            } else {
+                rc = NGX_OK;
+            }
+
+            if (rc == NGX_OK) {
+                rc = ngx_http_minify_special(r, ctx, b);
+            }
+
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if (rc == NGX_AGAIN) {
+                /* a thread task or all output buffers are busy */
+                break;
+            }
+
+            if (ctx->done) {
+                ctx->in = NULL;
+                break;
+            }
+
+            ctx->in = ctx->in->next;
+        }
+
+        if (ctx->buf && ctx->buf->last > ctx->buf->pos) {
+            if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+                return NGX_ERROR;
+            }
+        }
+
+        if (ctx->in) {
+            r->buffered |= NGX_HTTP_MINIFY_BUFFERED;
+
+        } else {
+            r->buffered &= ~NGX_HTTP_MINIFY_BUFFERED;
+        }
+
+        if (ctx->header) {
+
+            if (!ctx->done && !ctx->nomem) {
+                /* the output is kept until the length is known */
+                return ctx->in ? NGX_AGAIN : NGX_OK;
+            }
+
+            ctx->header = 0;
+
+            if (ctx->done) {
+                rc = ngx_http_minify_send_header(r, ctx);
+
+            } else {
+                /* the output does not fit in minify_buffers, it is streamed */
+
+                ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                               "http minify length unknown");
+
+                ngx_http_clear_content_length(r);
+                ngx_http_weak_etag(r);
+
+                rc = ngx_http_next_header_filter(r);
+            }
+
+            if (rc == NGX_ERROR || rc > NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            if (r->header_only) {
+                /* not modified, the header was the last buffer */
+                ctx->out = NULL;
+                ctx->last_out = &ctx->out;
+                return NGX_OK;
+            }
+        }
+
+        out = ctx->out;
+        ctx->out = NULL;
+        ctx->last_out = &ctx->out;
+
+        rc = ngx_http_next_body_filter(r, out);
+
+        ngx_chain_update_chains(r->pool, &ctx->free, &ctx->busy, &out,
+                          (ngx_buf_tag_t) &ngx_http_minify_filter_module);
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (ctx->nomem && ctx->free) {
+            /* the buffers sent meanwhile are reused */
+            ctx->nomem = 0;
+            continue;
+        }
+
+        break;
+    }
+
+    if (rc == NGX_OK && ctx->in) {
+        return NGX_AGAIN;
+    }
+
+    return rc;
+}
+
+
+/*
+ * A file buffer is read in chunks and streamed through the minifier. If
+ * the file is the whole response, its minified content may come from or
+ * go to the minify cache.
+ */
+
+static ngx_int_t
+ngx_http_minify_file(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b)
+{
+    size_t                   size;
+    ssize_t                  n;
+    ngx_int_t                rc;
+    ngx_buf_t               *rb;
+    ngx_http_minify_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    if ((conf->cache_zone || conf->cache_path)
+        && !ctx->started
+        && b->file_pos == 0
+        && (b->last_buf || b->last_in_chain))
+    {
+        rc = ngx_http_minify_cache_open(r, ctx, b);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
+
+    while (conf->mmap
+           && b->file_pos < b->file_last
+           && (ctx->readbuf == NULL
+               || ctx->readbuf->pos == ctx->readbuf->last))
+    {
+        if (ctx->map == NULL) {
+            rc = ngx_http_minify_map_file(r, ctx, b);
+
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if (rc == NGX_DECLINED) {
+                break;
+            }
+        }
+
+        if (ctx->map->pos < ctx->map->last) {
+            rc = ngx_http_minify_memory(r, ctx, ctx->map);
+
+            if (rc != NGX_OK) {
+                return rc;
+            }
+        }
+
+        b->file_pos = ctx->map->file_last;
+
+        ngx_http_minify_unmap_file(&ctx->mapping);
+        ctx->map = NULL;
+    }
+
+    if (ctx->readbuf == NULL && b->file_pos < b->file_last) {
+        size = (size_t) ngx_min(b->file_last - b->file_pos,
+                                NGX_HTTP_MINIFY_READ_SIZE);
+
+        ctx->readbuf = ngx_create_temp_buf(r->pool, size);
+        if (ctx->readbuf == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    rb = ctx->readbuf;
+
+#if (NGX_THREADS)
+
+    if (conf->thread_pool
+        && b->file_pos < b->file_last
+        && (size_t) (b->file_last - b->file_pos) >= conf->thread_threshold)
+    {
+        return ngx_http_minify_thread_post(r, ctx, b);
+    }
+
+#endif
+
+    for ( ;; ) {
+
+        if (rb == NULL || rb->pos == rb->last) {
+
+            if (b->file_pos == b->file_last) {
+                return NGX_OK;
+            }
+
+            size = (size_t) ngx_min(b->file_last - b->file_pos,
+                                    rb->end - rb->start);
+
+            n = ngx_http_minify_read_file(r, ctx, b, rb->start, size);
+
+            if (n == NGX_AGAIN) {
+                return NGX_AGAIN;
+            }
+
+            if (n == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if ((size_t) n != size) {
+                ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                              ngx_read_file_n " read only %z of %uz "
+                              "from \"%V\"", n, size, &b->file->name);
+                return NGX_ERROR;
+            }
+
+            rb->pos = rb->start;
+            rb->last = rb->start + n;
+
+            b->file_pos += n;
+        }
+
+        rc = ngx_http_minify_process(r, ctx, rb, 0);
+
+        if (rc != NGX_OK) {
+            return rc;
+        }
+    }
+}
+
+
+/*
+ * With minify_mmap a file buffer is mapped in windows of at most
+ * NGX_HTTP_MINIFY_MAP_SIZE and minified in place, so only the output is
+ * copied. A window is unmapped as soon as it is consumed, the cleanup only
+ * unmaps the one in use when the request ends. If mmap() fails the file is
+ * read as usual.
+ */
+
+static ngx_int_t
+ngx_http_minify_map_file(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b)
+{
+    off_t                offset;
+    size_t               size;
+    u_char              *addr;
+    ngx_buf_t           *mb;
+    ngx_pool_cleanup_t  *cln;
+
+    if (ctx->mapping.log == NULL) {
+        cln = ngx_pool_cleanup_add(r->pool, 0);
+        if (cln == NULL) {
+            return NGX_ERROR;
+        }
+
+        cln->handler = ngx_http_minify_unmap_file;
+        cln->data = &ctx->mapping;
+
+        ctx->mapping.log = r->connection->log;
+    }
+
+    mb = ngx_calloc_buf(r->pool);
+    if (mb == NULL) {
+        return NGX_ERROR;
+    }
+
+    offset = b->file_pos & ~((off_t) ngx_pagesize - 1);
+    size = (size_t) ngx_min(b->file_last - offset, NGX_HTTP_MINIFY_MAP_SIZE);
+
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, b->file->fd, offset);
+
+    if (addr == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, ngx_errno,
+                      "mmap(%uz) \"%V\" failed, reading the file",
+                      size, &b->file->name);
+        return NGX_DECLINED;
+    }
+
+    ctx->mapping.addr = addr;
+    ctx->mapping.size = size;
+
+    mb->start = addr;
+    mb->pos = addr + (size_t) (b->file_pos - offset);
+    mb->last = addr + size;
+    mb->end = mb->last;
+    mb->file_pos = b->file_pos;
+    mb->file_last = offset + size;
+    mb->mmap = 1;
+
+    ctx->map = mb;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify mmap: %p:%uz @%O", addr, size, offset);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_minify_unmap_file(void *data)
+{
+    ngx_http_minify_map_t  *map = data;
+
+    if (map->addr == NULL) {
+        return;
+    }
+
+    if (munmap(map->addr, map->size) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, map->log, ngx_errno,
+                      "munmap(%p, %uz) failed", map->addr, map->size);
+    }
+
+    map->addr = NULL;
+}
+
+
+/*
+ * Reads a chunk of a file buffer the way the copy filter would: with
+ * "aio threads" or "aio on" the read is asynchronous and NGX_AGAIN is
+ * returned, the request is blocked until the read completes and the same
+ * read is then issued again to fetch its result.
+ */
+
+static ssize_t
+ngx_http_minify_read_file(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b, u_char *buf, size_t size)
+{
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO)
+    ssize_t                    n;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+#endif
+
+#if (NGX_THREADS)
+
+    if (clcf->aio == NGX_HTTP_AIO_THREADS) {
+        b->file->thread_handler = ngx_http_minify_thread_read_handler;
+        b->file->thread_ctx = r;
+
+        n = ngx_thread_read(b->file, buf, size, b->file_pos, r->pool);
+
+        if (n == NGX_AGAIN) {
+            ctx->aio = 1;
+        }
+
+        return n;
+    }
+
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+
+    if (ngx_file_aio && clcf->aio == NGX_HTTP_AIO_ON) {
+
+        n = ngx_file_aio_read(b->file, buf, size, b->file_pos, r->pool);
+
+        if (n == NGX_AGAIN) {
+            b->file->aio->data = r;
+            b->file->aio->handler = ngx_http_minify_aio_event_handler;
+
+            r->main->blocked++;
+            r->aio = 1;
+            ctx->aio = 1;
+        }
+
+        return n;
+    }
+
+#endif
+
+    return ngx_read_file(b->file, buf, size, b->file_pos);
+}
+
+
+#if (NGX_HAVE_FILE_AIO)
+
+static void
+ngx_http_minify_aio_event_handler(ngx_event_t *ev)
+{
+    ngx_event_aio_t  *aio;
+
+    aio = ev->data;
+
+    ngx_http_minify_aio_done(aio->data);
+}
+
+#endif
+
+
+#if (NGX_THREADS)
+
+static ngx_int_t
+ngx_http_minify_thread_read_handler(ngx_thread_task_t *task, ngx_file_t *file)
+{
+    ngx_str_t                  name;
+    ngx_thread_pool_t         *tp;
+    ngx_http_request_t        *r;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    r = file->thread_ctx;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+    tp = clcf->thread_pool;
+
+    if (tp == NULL) {
+        if (ngx_http_complex_value(r, clcf->thread_pool_value, &name)
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        tp = ngx_thread_pool_get((ngx_cycle_t *) ngx_cycle, &name);
+
+        if (tp == NULL) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "thread pool \"%V\" not found", &name);
+            return NGX_ERROR;
+        }
+    }
+
+    task->event.data = r;
+    task->event.handler = ngx_http_minify_thread_read_event_handler;
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    r->main->blocked++;
+    r->aio = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_minify_thread_read_event_handler(ngx_event_t *ev)
+{
+    ngx_http_minify_aio_done(ev->data);
+}
+
+#endif
+
+
+static void
+ngx_http_minify_aio_done(ngx_http_request_t *r)
+{
+    ngx_connection_t       *c;
+    ngx_http_minify_ctx_t  *ctx;
+
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http minify aio: \"%V?%V\"", &r->uri, &r->args);
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    ctx->aio = 0;
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    if (r->done || r->main->terminated) {
+        /*
+         * the request was finalized or terminated while the read or the
+         * task was in progress: let the connection event handler finish
+         * it, as the copy filter does
+         */
+
+        c->write->handler(c->write);
+        return;
+    }
+
+    r->write_event_handler(r);
+
+    ngx_http_run_posted_requests(c);
+}
+
+
+static ngx_int_t
+ngx_http_minify_memory(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b)
+{
+    ngx_int_t                rc;
+#if (NGX_THREADS)
+    ngx_http_minify_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    if (conf->thread_pool
+        && (size_t) (b->last - b->pos) >= conf->thread_threshold)
+    {
+        return ngx_http_minify_thread_post(r, ctx, b);
+    }
+#endif
+
+    rc = ngx_http_minify_process(r, ctx, b, 0);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    b->pos = b->last;
+    b->file_pos = b->file_last;
+
+    return NGX_OK;
+}
+
+
+/*
+ * Finishes the minifier on the last buffer and passes the flags of special
+ * buffers on in a buffer of our own.
+ */
+
+static ngx_int_t
+ngx_http_minify_special(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b)
+{
+    ngx_int_t                rc;
+    ngx_md5_t                md5;
+    ngx_chain_t             *cl;
+    ngx_http_minify_conf_t  *conf;
+    u_char                   hash[16];
+
+    if (b->last_buf || b->last_in_chain) {
+
+        if (!ctx->done) {
+            rc = ngx_http_minify_process(r, ctx, NULL, 1);
+
+            if (rc != NGX_OK) {
+                return rc;
+            }
+        }
+
+        ctx->done = 1;
+    }
+
+    if (!(b->last_buf || b->last_in_chain || b->flush || b->sync)) {
+        return NGX_OK;
+    }
+
+    if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (ctx->done && ctx->cache_last) {
+        conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+        ngx_md5_init(&md5);
+
+        for (cl = ctx->cache_out; cl; cl = cl->next) {
+            ngx_md5_update(&md5, cl->buf->pos, cl->buf->last - cl->buf->pos);
+        }
+
+        ngx_md5_final(hash, &md5);
+
+        ngx_memcpy(ctx->etag, hash, NGX_HTTP_MINIFY_ETAG_LEN);
+        ctx->hashed = 1;
+
+#if (NGX_HTTP_GZIP && NGX_ZLIB)
+
+        /* a larger file has its header sent before the cache is looked up */
+
+        if (conf->cache_gzip
+            && ctx->cache_len
+            && ctx->cache_len <= conf->exact_length)
+        {
+            ngx_http_minify_cache_gzip(r, ctx);
+        }
+
+#endif
+
+        if (conf->cache_zone) {
+            ngx_http_minify_cache_store(r, conf->cache_zone, ctx->cache_name,
+                                        ctx->cache_of, ctx);
+        }
+
+        if (ctx->cache_file.len) {
+            ngx_http_minify_cache_file_write(r, ctx);
+        }
+
+        ctx->cache_out = NULL;
+        ctx->cache_last = NULL;
+    }
+
+    ctx->buf = ngx_calloc_buf(r->pool);
+    if (ctx->buf == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->buf->flush = b->flush;
+    ctx->buf->last_buf = b->last_buf;
+    ctx->buf->last_in_chain = b->last_in_chain;
+    ctx->buf->sync = b->sync
+                     || (b->last_in_chain && !b->last_buf && !b->flush);
+
+    return ngx_http_minify_flush_buf(r, ctx);
+}
+
+
+static ngx_int_t
+ngx_http_minify_process(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *in, ngx_uint_t last)
+{
+    ngx_int_t  rc;
+
+    ctx->started = 1;
+
+    for ( ;; ) {
+
+        if (ctx->buf == NULL || ctx->buf->start == NULL) {
+            rc = ngx_http_minify_get_buf(r, ctx);
+
+            if (rc != NGX_OK) {
+                return rc;
+            }
+        }
+
+        if (ngx_http_minify_run(ctx, in, ctx->buf, last) == NGX_OK) {
+            return NGX_OK;
+        }
+
+        /* NGX_AGAIN: the output buffer is full */
+
+        if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+}
+
+
+/*
+ * The output buffers of minify_buffers are reused once they are sent. If
+ * all of them are busy, NGX_AGAIN is returned and the minification goes
+ * on when the filter is called again. The output that is kept for the
+ * header counts against minify_buffers too: when they are exhausted the
+ * header is sent without the length. The output kept for the cache is not
+ * limited and its buffers are not reused.
+ */
+
+static ngx_int_t
+ngx_http_minify_get_buf(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx)
+{
+    ngx_chain_t             *cl;
+    ngx_http_minify_conf_t  *conf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    if (ctx->cache_last == NULL) {
+
+        if (!ctx->header && ctx->free) {
+            cl = ctx->free;
+            ctx->buf = cl->buf;
+            ctx->free = cl->next;
+
+            ngx_free_chain(r->pool, cl);
+
+            return NGX_OK;
+        }
+
+        if (ctx->bufs >= conf->bufs.num) {
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "http minify no free buffers");
+
+            ctx->nomem = 1;
+            return NGX_AGAIN;
+        }
+    }
+
+    ctx->buf = ngx_create_temp_buf(r->pool, conf->bufs.size);
+    if (ctx->buf == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->buf->tag = (ngx_buf_tag_t) &ngx_http_minify_filter_module;
+    ctx->buf->recycled = 1;
+
+    ctx->bufs++;
+
+    return NGX_OK;
+}
+
+
+/* may be called in a thread: allocates nothing and does not log */
+
+static ngx_int_t
+ngx_http_minify_run(ngx_http_minify_ctx_t *ctx, ngx_buf_t *in, ngx_buf_t *out,
+    ngx_uint_t last)
+{
+    u_char     *pos, *start;
+    uint64_t    time;
+    ngx_int_t   rc;
+
+    pos = in ? in->pos : NULL;
+    start = out->last;
+    time = ngx_http_minify_time();
+
+    switch (ctx->type) {
+
+    case NGX_HTTP_MINIFY_JS:
+        rc = jsmin(&ctx->u.js, in, out, last);
+        break;
+
+    case NGX_HTTP_MINIFY_CSS:
+        rc = cssmin(&ctx->u.css, in, out, last);
+        break;
+
+    case NGX_HTTP_MINIFY_HTML:
+        rc = htmlmin(&ctx->u.html, in, out, last);
+        break;
+
+    case NGX_HTTP_MINIFY_JSON:
+        rc = jsonmin(&ctx->u.json, in, out, last);
+        break;
+
+    default: /* NGX_HTTP_MINIFY_XML */
+        rc = xmlmin(&ctx->u.xml, in, out, last);
+        break;
+    }
+
+    ctx->time += ngx_http_minify_time() - time;
+    ctx->bytes_in += in ? in->pos - pos : 0;
+    ctx->bytes_out += out->last - start;
+
+    return rc;
+}
+
+
+/* a monotonic clock, ngx_current_msec is too coarse for a buffer */
+
+static uint64_t
+ngx_http_minify_time(void)
+{
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    struct timeval   tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+
+static ngx_int_t
+ngx_http_minify_flush_buf(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx)
+{
+    ngx_chain_t  *cl;
+
+    if (ctx->buf == NULL) {
+        return NGX_OK;
+    }
+
+    if (ngx_buf_size(ctx->buf) == 0 && !ngx_buf_special(ctx->buf)) {
+        /* an empty buffer is reused */
+        return NGX_OK;
+    }
+
+    if (ctx->cache_last
+        && ngx_http_minify_cache_collect(r, ctx, ctx->buf) != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = ctx->buf;
+    cl->next = NULL;
+
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    ctx->buf = NULL;
+
+    return NGX_OK;
+}
+
+
+#if (NGX_THREADS)
+
+/*
+ * Buffers of at least minify_thread_pool threshold= bytes are minified in
+ * a thread, so that a large script does not stall the other connections of
+ * the worker. The request is blocked like for "aio threads" meanwhile, and
+ * the output is collected when the writer calls the filter again.
+ *
+ * A task minifies the whole buffer in one go. It cannot allocate, so it is
+ * given the output buffers that the input may need, taken from the buffers
+ * of minify_buffers on this side. If the output does not fit in them, the
+ * rest of the input is left for another task.
+ */
+
+static ngx_int_t
+ngx_http_minify_thread_post(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b)
+{
+    off_t                          size;
+    ngx_int_t                      rc;
+    ngx_uint_t                     n;
+    ngx_chain_t                   *cl, **ll;
+    ngx_thread_task_t             *task;
+    ngx_http_minify_conf_t        *conf;
+    ngx_http_minify_thread_ctx_t  *tctx;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    /* the output of the task goes after the output produced so far */
+
+    if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    task = ctx->task;
+
+    if (task == NULL) {
+        task = ngx_thread_task_alloc(r->pool,
+                                     sizeof(ngx_http_minify_thread_ctx_t));
+        if (task == NULL) {
+            return NGX_ERROR;
+        }
+
+        task->handler = ngx_http_minify_thread_handler;
+        task->event.handler = ngx_http_minify_thread_event_handler;
+        task->event.data = r;
+
+        ctx->task = task;
+    }
+
+    tctx = task->ctx;
+
+    tctx->ctx = ctx;
+    tctx->buf = b;
+    tctx->out = NULL;
+    tctx->err = 0;
+    tctx->failed = 0;
+
+    /* a buffer holds at least its size less the reserve of the engines */
+
+    size = ngx_buf_in_memory(b) ? b->last - b->pos
+                                : b->file_last - b->file_pos;
+
+    n = (ngx_uint_t) (size / (off_t) (conf->bufs.size
+                                      - NGX_HTTP_MINIFY_RESERVE)) + 1;
+    n = ngx_min(n, conf->bufs.num);
+
+    ll = &tctx->out;
+
+    while (n--) {
+
+        if (ctx->buf == NULL || ctx->buf->start == NULL) {
+            rc = ngx_http_minify_get_buf(r, ctx);
+
+            if (rc == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            if (rc == NGX_AGAIN) {
+                break;
+            }
+        }
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl->buf = ctx->buf;
+        *ll = cl;
+        ll = &cl->next;
+
+        ctx->buf = NULL;
+    }
+
+    *ll = NULL;
+
+    if (tctx->out == NULL) {
+        /* all output buffers are busy */
+        return NGX_AGAIN;
+    }
+
+    ctx->nomem = 0;
+
+    if (ngx_thread_task_post(conf->thread_pool, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify thread post: %O", size);
+
+    ctx->started = 1;
+    ctx->thread_posted = 1;
+    ctx->aio = 1;
+
+    r->main->blocked++;
+    r->aio = 1;
+
+    return NGX_AGAIN;
+}
+
+
+static void
+ngx_http_minify_thread_handler(void *data, ngx_log_t *log)
+{
+    ngx_http_minify_thread_ctx_t *tctx = data;
+
+    size_t                  size;
+    ssize_t                 n;
+    ngx_buf_t              *b, *rb;
+    ngx_chain_t            *cl;
+    ngx_http_minify_ctx_t  *ctx;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "http minify thread handler");
+
+    ctx = tctx->ctx;
+    b = tctx->buf;
+    cl = tctx->out;
+
+    if (ngx_buf_in_memory(b)) {
+
+        while (cl) {
+            if (ngx_http_minify_run(ctx, b, cl->buf, 0) == NGX_OK) {
+                return;
+            }
+
+            cl = cl->next;
+        }
+
+        return;
+    }
+
+    rb = ctx->readbuf;
+
+    for ( ;; ) {
+
+        if (rb->pos == rb->last) {
+
+            if (b->file_pos == b->file_last) {
+                return;
+            }
+
+            size = (size_t) ngx_min(b->file_last - b->file_pos,
+                                    rb->end - rb->start);
+
+            n = pread(b->file->fd, rb->start, size, b->file_pos);
+
+            if (n == -1) {
+                tctx->err = ngx_errno;
+                tctx->failed = 1;
+                return;
+            }
+
+            if ((size_t) n != size) {
+                tctx->failed = 1;
+                return;
+            }
+
+            rb->pos = rb->start;
+            rb->last = rb->start + n;
+
+            b->file_pos += n;
+        }
+
+        if (ngx_http_minify_run(ctx, rb, cl->buf, 0) == NGX_AGAIN) {
+            cl = cl->next;
+
+            if (cl == NULL) {
+                return;
+            }
+        }
+    }
+}
+
+
+/* a request terminated while the task ran is finished like after a read */
+
+static void
+ngx_http_minify_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_http_minify_aio_done(ev->data);
+}
+
+
+static ngx_int_t
+ngx_http_minify_thread_done(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx)
+{
+    ngx_buf_t                     *b;
+    ngx_chain_t                   *cl, *ln;
+    ngx_http_minify_thread_ctx_t  *tctx;
+
+    tctx = ctx->task->ctx;
+    b = tctx->buf;
+
+    ctx->thread_posted = 0;
+
+    if (tctx->failed) {
+        if (tctx->err) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, tctx->err,
+                          "pread() \"%V\" failed", &b->file->name);
+
+        } else {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, 0,
+                          "pread() read only part of \"%V\"",
+                          &b->file->name);
+        }
+
+        return NGX_ERROR;
+    }
+
+    if (ngx_buf_in_memory(b) && b->pos == b->last) {
+        b->file_pos = b->file_last;
+    }
+
+    /*
+     * The buffers filled by the task are passed on. The first one left
+     * empty becomes the current buffer, the others go to the free buffers
+     * if those are reused, and stay charged to minify_buffers otherwise.
+     */
+
+    for (cl = tctx->out; cl; cl = ln) {
+        ln = cl->next;
+
+        if (ngx_buf_size(cl->buf)) {
+            ctx->buf = cl->buf;
+
+            if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            ngx_free_chain(r->pool, cl);
+            continue;
+        }
+
+        if (ctx->buf == NULL) {
+            ctx->buf = cl->buf;
+            ngx_free_chain(r->pool, cl);
+            continue;
+        }
+
+        if (!ctx->header && ctx->cache_last == NULL) {
+            cl->next = ctx->free;
+            ctx->free = cl;
+        }
+    }
+
+    tctx->out = NULL;
+
+    return NGX_OK;
+}
+
+#endif
+
+
+/*
+ * Looks the file up in the minify cache zone and then in the cache
+ * directory. On a miss the minified output is collected in ctx->cache_out,
+ * to be stored once the file is over.
+ */
+
+static ngx_int_t
+ngx_http_minify_cache_open(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx,
+    ngx_buf_t *b)
+{
+    ngx_int_t                  rc;
+    ngx_uint_t                 gzip;
+    ngx_open_file_info_t      *of;
+    ngx_http_minify_conf_t    *conf;
+    ngx_http_core_loc_conf_t  *ccf;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+    ccf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    of = ngx_pcalloc(r->pool, sizeof(ngx_open_file_info_t));
+    if (of == NULL) {
+        return NGX_ERROR;
+    }
+
+    of->read_ahead = ccf->read_ahead;
+    of->directio = ccf->directio;
+    of->valid = ccf->open_file_cache_valid;
+    of->min_uses = ccf->open_file_cache_min_uses;
+    of->errors = ccf->open_file_cache_errors;
+    of->events = ccf->open_file_cache_events;
+
+    if (ngx_open_cached_file(ccf->open_file_cache, &b->file->name, of,
+                             r->pool)
+        != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, of->err,
+                      "%s \"%V\" failed", of->failed, &b->file->name);
+        return NGX_ERROR;
+    }
+
+    if (!of->is_file || b->file_last != of->size) {
+        return NGX_DECLINED;
+    }
+
+    if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ctx->buf = ngx_calloc_buf(r->pool);
+    if (ctx->buf == NULL) {
+        return NGX_ERROR;
+    }
+
+    gzip = 0;
+
+#if (NGX_HTTP_GZIP && NGX_ZLIB)
+
+    /* the encoding can only be changed while the header is not sent */
+
+    if (conf->cache_gzip && ctx->header && ngx_http_gzip_ok(r) == NGX_OK) {
+        gzip = 1;
+    }
+
+#endif
+
+    rc = NGX_DECLINED;
+
+    if (conf->cache_zone) {
+        rc = ngx_http_minify_cache_lookup(r, conf->cache_zone,
+                                          &b->file->name, of, ctx->buf,
+                                          ctx->etag, &gzip, &ctx->bytes_out);
+    }
+
+    if (rc == NGX_DECLINED && conf->cache_path) {
+        rc = ngx_http_minify_cache_file_open(r, ctx, &b->file->name, of,
+                                             &gzip);
+    }
+
+    if (rc == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (rc == NGX_OK) {
+        ctx->done = 1;
+        ctx->hashed = 1;
+        ctx->gzip = gzip;
+        ctx->cache_status = NGX_HTTP_MINIFY_CACHE_HIT;
+        b->file_pos = b->file_last;
+
+        /* the source and the minified lengths, for the variables */
+
+        ctx->bytes_in = of->size;
+
+        if (ngx_http_minify_flush_buf(r, ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        return NGX_OK;
+    }
+
+    /* all output from now on belongs to the file */
+
+    ctx->cache_status = NGX_HTTP_MINIFY_CACHE_MISS;
+
+    ctx->cache_out = NULL;
+    ctx->cache_last = &ctx->cache_out;
+    ctx->cache_len = 0;
+
+    ctx->cache_name = &b->file->name;
+    ctx->cache_of = of;
+
+    return NGX_DECLINED;
+}
+
+
+/*
+ * The output buffers are not reused once they are passed on, so the cache
+ * keeps a chain of buffers pointing to their data as it was sent, without
+ * copying it: only the exact size of the minified content is stored.
+ */
+
+static ngx_int_t
+ngx_http_minify_cache_collect(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_buf_t *b)
+{
+    ngx_buf_t    *cb;
+    ngx_chain_t  *cl;
+
+    if (b->last == b->pos) {
+        return NGX_OK;
+    }
+
+    cb = ngx_calloc_buf(r->pool);
+    if (cb == NULL) {
+        return NGX_ERROR;
+    }
+
+    cb->pos = b->pos;
+    cb->last = b->last;
+    cb->memory = 1;
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl->buf = cb;
+    cl->next = NULL;
+
+    *ctx->cache_last = cl;
+    ctx->cache_last = &cl->next;
+
+    ctx->cache_len += b->last - b->pos;
+
+    return NGX_OK;
+}
+
+
+/*
+ * A file of the cache directory is named by the MD5 of the source file
+ * name and identity, so an edited source file simply gets a new entry and
+ * the old one ages out. A hit is sent from the cache file as is.
+ */
+
+static ngx_int_t
+ngx_http_minify_cache_file_open(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx, ngx_str_t *name, ngx_open_file_info_t *sof,
+    ngx_uint_t *gzip)
+{
+    off_t                  length;
+    ngx_int_t              rc;
+    ngx_buf_t             *b;
+    ngx_open_file_info_t   of;
+
+    if (ngx_http_minify_cache_file_name(r, name, sof, &ctx->cache_file)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(&of, sizeof(ngx_open_file_info_t));
+
+    rc = ngx_http_minify_cache_file_read(r, &ctx->cache_file, &of,
+                                         ctx->etag, &length);
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    b = ctx->buf;
+
+    b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
+    if (b->file == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->bytes_out = length;
+
+    b->file_pos = sizeof(ngx_http_minify_cache_header_t);
+    b->file_last = b->file_pos + length;
+
+    if (*gzip) {
+        if (of.size > b->file_last) {
+            b->file_pos = b->file_last;
+            b->file_last = of.size;
+
+        } else {
+            *gzip = 0;
+        }
+    }
+
+    b->in_file = (b->file_last > b->file_pos) ? 1 : 0;
+
+    b->file->fd = of.fd;
+    b->file->name = ctx->cache_file;
+    b->file->log = r->connection->log;
+    b->file->directio = of.is_directio;
+
+    /* nothing to write back */
+
+    ctx->cache_file.len = 0;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify cache file hit");
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_cache_file_name(ngx_http_request_t *r, ngx_str_t *name,
+    ngx_open_file_info_t *sof, ngx_str_t *file)
+{
+    u_char                  *p;
+    size_t                   len;
+    ngx_md5_t                md5;
+    ngx_path_t              *path;
+    ngx_http_minify_conf_t  *conf;
+    u_char                   key[NGX_HTTP_MINIFY_CACHE_KEY_LEN];
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    path = conf->cache_path->path;
+
+    ngx_md5_init(&md5);
+    ngx_md5_update(&md5, name->data, name->len);
+    ngx_md5_update(&md5, &sof->uniq, sizeof(ngx_file_uniq_t));
+    ngx_md5_update(&md5, &sof->mtime, sizeof(time_t));
+    ngx_md5_update(&md5, &sof->size, sizeof(off_t));
+    ngx_md5_final(key, &md5);
+
+    len = path->name.len + 1 + path->len + 2 * NGX_HTTP_MINIFY_CACHE_KEY_LEN;
+
+    file->data = ngx_pnalloc(r->pool, len + 1);
+    if (file->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    file->len = len;
+
+    ngx_memcpy(file->data, path->name.data, path->name.len);
+
+    p = file->data + path->name.len + 1 + path->len;
+    p = ngx_hex_dump(p, key, NGX_HTTP_MINIFY_CACHE_KEY_LEN);
+    *p = '\0';
+
+    ngx_create_hashed_filename(path, file->data, file->len);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify cache file: \"%s\"", file->data);
+
+    return NGX_OK;
+}
+
+
+/*
+ * A cache file starts with a signature, the ETag and the length of the
+ * minified content that follows. The rest of the file, if any, is its gzip
+ * variant.
+ */
+
+static ngx_int_t
+ngx_http_minify_cache_file_read(ngx_http_request_t *r, ngx_str_t *file,
+    ngx_open_file_info_t *of, u_char *etag, off_t *length)
+{
+    ssize_t                          n;
+    ngx_file_t                       f;
+    ngx_http_core_loc_conf_t        *ccf;
+    ngx_http_minify_cache_header_t   h;
+
+    ccf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    of->read_ahead = ccf->read_ahead;
+    of->directio = ccf->directio;
+    of->valid = ccf->open_file_cache_valid;
+    of->min_uses = ccf->open_file_cache_min_uses;
+    of->events = ccf->open_file_cache_events;
+
+    if (ngx_open_cached_file(ccf->open_file_cache, file, of, r->pool)
+        != NGX_OK)
+    {
+        if (of->err != NGX_ENOENT && of->err != NGX_ENOTDIR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, of->err,
+                          "%s \"%s\" failed", of->failed, file->data);
+        }
+
+        return NGX_DECLINED;
+    }
+
+    if (!of->is_file
+        || of->size < (off_t) sizeof(ngx_http_minify_cache_header_t))
+    {
+        return NGX_DECLINED;
+    }
+
+    ngx_memzero(&f, sizeof(ngx_file_t));
+
+    f.fd = of->fd;
+    f.name = *file;
+    f.log = r->connection->log;
+
+    n = ngx_read_file(&f, (u_char *) &h, sizeof(h), 0);
+
+    if (n == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if ((size_t) n != sizeof(h)
+        || ngx_memcmp(h.signature, NGX_HTTP_MINIFY_CACHE_SIGNATURE,
+                      sizeof(h.signature))
+           != 0
+        || h.length < 0
+        || h.length > of->size - (off_t) sizeof(h))
+    {
+        ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                      "minify cache file \"%s\" has invalid header",
+                      file->data);
+        return NGX_DECLINED;
+    }
+
+    ngx_memcpy(etag, h.etag, NGX_HTTP_MINIFY_ETAG_LEN);
+    *length = h.length;
+
+    return NGX_OK;
+}
+
+
+/*
+ * The cache file is written by the worker with blocking calls, like the
+ * temporary files of the proxy cache without "aio_write". It is written
+ * only once for each version of a source file.
+ */
+
+static void
+ngx_http_minify_cache_file_write(ngx_http_request_t *r,
+    ngx_http_minify_ctx_t *ctx)
+{
+    ssize_t                          n;
+    ngx_buf_t                        hb;
+    ngx_file_t                       file;
+    ngx_chain_t                      hcl;
+    ngx_ext_rename_file_t            ext;
+    ngx_http_minify_conf_t          *conf;
+    ngx_http_minify_cache_header_t   h;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+
+    file.log = r->connection->log;
+
+    if (ngx_create_temp_file(&file, conf->cache_path->path, r->pool, 1, 0,
+                             NGX_FILE_DEFAULT_ACCESS)
+        != NGX_OK)
+    {
+        return;
+    }
+
+    ngx_memcpy(h.signature, NGX_HTTP_MINIFY_CACHE_SIGNATURE,
+               sizeof(h.signature));
+    ngx_memcpy(h.etag, ctx->etag, NGX_HTTP_MINIFY_ETAG_LEN);
+    h.length = ctx->cache_len;
+
+    ngx_memzero(&hb, sizeof(ngx_buf_t));
+
+    hb.pos = (u_char *) &h;
+    hb.last = hb.pos + sizeof(h);
+    hb.memory = 1;
+
+    hcl.buf = &hb;
+    hcl.next = ctx->cache_out;
+
+    /* the gzip variant follows the minified content */
+
+    *ctx->cache_last = ctx->cache_gzip;
+
+    n = ngx_write_chain_to_file(&file, &hcl, 0, r->pool);
+
+    if (n == NGX_ERROR
+        || (size_t) n != sizeof(h) + ctx->cache_len + ctx->cache_gzip_len)
+    {
+        if (ngx_delete_file(file.name.data) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                          ngx_delete_file_n " \"%s\" failed", file.name.data);
+        }
+
+        return;
+    }
+
+    ext.access = 0;
+    ext.path_access = 0700;
+    ext.time = -1;
+    ext.create_path = 1;
+    ext.delete_file = 1;
+    ext.fd = file.fd;
+    ext.log = r->connection->log;
+
+    if (ngx_ext_rename_file(&file.name, &ctx->cache_file, &ext) != NGX_OK) {
+        return;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify cache file store: \"%s\" %uz",
+                   ctx->cache_file.data, ctx->cache_len);
+}
+
+
+#if (NGX_HTTP_GZIP && NGX_ZLIB)
+
+/*
+ * The gzip variant is compressed only once, when the minified content is
+ * stored, so the best compression is used. It is kept only if it is
+ * smaller than the minified content.
+ */
+
+static void
+ngx_http_minify_cache_gzip(ngx_http_request_t *r, ngx_http_minify_ctx_t *ctx)
+{
+    int           rc, flush;
+    size_t        len;
+    z_stream      zstream;
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    ngx_memzero(&zstream, sizeof(z_stream));
+
+    rc = deflateInit2(&zstream, Z_BEST_COMPRESSION, Z_DEFLATED,
+                      MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+
+    if (rc != Z_OK) {
+        ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                      "deflateInit2() failed: %d", rc);
+        return;
+    }
+
+    len = deflateBound(&zstream, ctx->cache_len);
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        deflateEnd(&zstream);
+        return;
+    }
+
+    zstream.next_out = b->last;
+    zstream.avail_out = len;
+
+    for (cl = ctx->cache_out; cl; cl = cl->next) {
+        zstream.next_in = cl->buf->pos;
+        zstream.avail_in = cl->buf->last - cl->buf->pos;
+
+        flush = cl->next ? Z_NO_FLUSH : Z_FINISH;
+
+        rc = deflate(&zstream, flush);
+
+        if (rc != (flush == Z_FINISH ? Z_STREAM_END : Z_OK)) {
+            ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                          "deflate() failed: %d, %d", flush, rc);
+            deflateEnd(&zstream);
+            return;
+        }
+    }
+
+    b->last = zstream.next_out;
+
+    deflateEnd(&zstream);
+
+    len = b->last - b->pos;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify cache gzip: %uz of %uz", len, ctx->cache_len);
+
+    if (len >= ctx->cache_len) {
+        return;
+    }
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return;
+    }
+
+    cl->buf = b;
+    cl->next = NULL;
+
+    ctx->cache_gzip = cl;
+    ctx->cache_gzip_len = len;
+}
+
+#endif
+
+
+/*
+ * The cache manager process keeps the cache directory below max_size by
+ * removing the oldest files; temporary files are left alone.
+ */
+
+static ngx_msec_t
+ngx_http_minify_cache_manager(void *data)
+{
+    ngx_http_minify_cache_path_t *cp = data;
+
+    off_t                          size;
+    ngx_uint_t                     i;
+    ngx_pool_t                    *pool;
+    ngx_array_t                    files;
+    ngx_tree_ctx_t                 tree;
+    ngx_http_minify_cache_file_t  *f;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_cycle->log);
+    if (pool == NULL) {
+        return NGX_HTTP_MINIFY_CACHE_MANAGER_SLEEP;
+    }
+
+    if (ngx_array_init(&files, pool, 64, sizeof(ngx_http_minify_cache_file_t))
+        != NGX_OK)
+    {
+        ngx_destroy_pool(pool);
+        return NGX_HTTP_MINIFY_CACHE_MANAGER_SLEEP;
+    }
+
+    tree.init_handler = NULL;
+    tree.file_handler = ngx_http_minify_cache_manage_file;
+    tree.pre_tree_handler = ngx_http_minify_cache_noop;
+    tree.post_tree_handler = ngx_http_minify_cache_noop;
+    tree.spec_handler = ngx_http_minify_cache_noop;
+    tree.data = &files;
+    tree.alloc = 0;
+    tree.log = ngx_cycle->log;
+
+    (void) ngx_walk_tree(&tree, &cp->path->name);
+
+    size = 0;
+    f = files.elts;
+
+    for (i = 0; i < files.nelts; i++) {
+        size += f[i].size;
+    }
+
+    if (size > cp->max_size) {
+        ngx_sort(files.elts, files.nelts, sizeof(ngx_http_minify_cache_file_t),
+                 ngx_http_minify_cache_cmp_files);
+
+        for (i = 0; i < files.nelts && size > cp->max_size; i++) {
+
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                           "http minify cache manager delete: \"%s\"",
+                           f[i].name.data);
+
+            if (ngx_delete_file(f[i].name.data) == NGX_FILE_ERROR) {
+                ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                              ngx_delete_file_n " \"%s\" failed",
+                              f[i].name.data);
+                continue;
+            }
+
+            size -= f[i].size;
+        }
+    }
+
+    ngx_destroy_pool(pool);
+
+    return NGX_HTTP_MINIFY_CACHE_MANAGER_SLEEP;
+}
+
+
+static ngx_int_t
+ngx_http_minify_cache_manage_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    ngx_array_t *files = ctx->data;
+
+    u_char                        *p;
+    ngx_http_minify_cache_file_t  *f;
+
+    /* cache files are named by the key, temporary files by a number */
+
+    for (p = path->data + path->len; p > path->data; p--) {
+        if (p[-1] == '/') {
+            break;
+        }
+    }
+
+    if ((size_t) (path->data + path->len - p)
+        != 2 * NGX_HTTP_MINIFY_CACHE_KEY_LEN)
+    {
+        return NGX_OK;
+    }
+
+    f = ngx_array_push(files);
+    if (f == NULL) {
+        return NGX_ABORT;
+    }
+
+    f->name.len = path->len;
+    f->name.data = ngx_pnalloc(files->pool, path->len + 1);
+    if (f->name.data == NULL) {
+        return NGX_ABORT;
+    }
+
+    ngx_memcpy(f->name.data, path->data, path->len + 1);
+
+    f->mtime = ctx->mtime;
+    f->size = ctx->size;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_cache_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_cache_cmp_files(const void *one, const void *two)
+{
+    ngx_http_minify_cache_file_t  *first, *second;
+
+    first = (ngx_http_minify_cache_file_t *) one;
+    second = (ngx_http_minify_cache_file_t *) two;
+
+    if (first->mtime < second->mtime) {
+        return -1;
+    }
+
+    return (first->mtime > second->mtime) ? 1 : 0;
+}
+
+
+static ngx_http_minify_cache_node_t *
+ngx_http_minify_cache_find(ngx_http_minify_cache_t *cache, ngx_str_t *name,
+    uint32_t hash)
+{
+    ngx_int_t                      rc;
+    ngx_rbtree_node_t             *node, *sentinel;
+    ngx_http_minify_cache_node_t  *cn;
+
+    node = cache->sh->rbtree.root;
+    sentinel = cache->sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (hash < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (hash > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* hash == node->key */
+
+        cn = (ngx_http_minify_cache_node_t *) &node->color;
+
+        rc = ngx_memn2cmp(name->data, cn->data, name->len, (size_t) cn->len);
+
+        if (rc == 0) {
+            return cn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_http_minify_cache_delete(ngx_http_minify_cache_t *cache,
+    ngx_http_minify_cache_node_t *cn)
+{
+    ngx_rbtree_node_t  *node;
+
+    node = (ngx_rbtree_node_t *)
+               ((u_char *) cn - offsetof(ngx_rbtree_node_t, color));
+
+    ngx_queue_remove(&cn->queue);
+    ngx_rbtree_delete(&cache->sh->rbtree, node);
+
+    if (cn->count) {
+        /* freed by the last request that sends it */
+        cn->deleted = 1;
+        return;
+    }
+
+    ngx_slab_free_locked(cache->shpool, node);
+}
+
+
+/*
+ * The cache is keyed by the file name; an entry is only valid while the
+ * inode, mtime and size reported by the open file cache still match, so
+ * an edited file is minified again and replaces its stale entry.
+ *
+ * A hit is sent straight from the zone: the node is pinned by its count,
+ * like the nodes of ngx_http_file_cache, so it is neither copied under the
+ * mutex nor freed while the request is sending it.
+ */
+
+static ngx_int_t
+ngx_http_minify_cache_lookup(ngx_http_request_t *r, ngx_shm_zone_t *zone,
+    ngx_str_t *name, ngx_open_file_info_t *of, ngx_buf_t *buf, u_char *etag,
+    ngx_uint_t *gzip, off_t *length)
+{
+    u_char                        *data;
+    size_t                         len;
+    uint32_t                       hash;
+    ngx_pool_cleanup_t            *cln;
+    ngx_http_minify_cache_t       *cache;
+    ngx_http_minify_cache_pin_t   *pin;
+    ngx_http_minify_cache_node_t  *cn;
+
+    cache = zone->data;
+    hash = ngx_crc32_short(name->data, name->len);
+
+    cln = NULL;
+
+    if (buf) {
+        cln = ngx_pool_cleanup_add(r->pool,
+                                   sizeof(ngx_http_minify_cache_pin_t));
+        if (cln == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    cn = ngx_http_minify_cache_find(cache, name, hash);
+
+    if (cn == NULL) {
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+        return NGX_DECLINED;
+    }
+
+    if (cn->uniq != of->uniq
+        || cn->mtime != of->mtime
+        || cn->size != of->size)
+    {
+        ngx_http_minify_cache_delete(cache, cn);
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http minify cache stale: \"%V\"", name);
+
+        return NGX_DECLINED;
+    }
+
+    ngx_queue_remove(&cn->queue);
+    ngx_queue_insert_head(&cache->sh->queue, &cn->queue);
+
+    ngx_memcpy(etag, cn->etag, NGX_HTTP_MINIFY_ETAG_LEN);
+
+    if (length) {
+        *length = cn->data_len;
+    }
+
+    data = cn->data + cn->len;
+    len = cn->data_len;
+
+    if (gzip && *gzip) {
+        if (cn->gzip_len) {
+            data += cn->data_len;
+            len = cn->gzip_len;
+
+        } else {
+            *gzip = 0;
+        }
+    }
+
+    if (buf && len) {
+        cn->count++;
+
+        pin = cln->data;
+        pin->cache = cache;
+        pin->node = cn;
+
+        cln->handler = ngx_http_minify_cache_unpin;
+
+        buf->start = data;
+        buf->pos = data;
+        buf->last = data + len;
+        buf->end = buf->last;
+        buf->memory = 1;
+    }
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify cache hit: \"%V\"", name);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_minify_cache_unpin(void *data)
+{
+    ngx_http_minify_cache_pin_t  *pin = data;
+
+    ngx_rbtree_node_t             *node;
+    ngx_http_minify_cache_t       *cache;
+    ngx_http_minify_cache_node_t  *cn;
+
+    cache = pin->cache;
+    cn = pin->node;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    cn->count--;
+
+    if (cn->count == 0 && cn->deleted) {
+        node = (ngx_rbtree_node_t *)
+                   ((u_char *) cn - offsetof(ngx_rbtree_node_t, color));
+
+        ngx_slab_free_locked(cache->shpool, node);
+    }
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+}
+
+
+static void
+ngx_http_minify_cache_store(ngx_http_request_t *r, ngx_shm_zone_t *zone,
+    ngx_str_t *name, ngx_open_file_info_t *of, ngx_http_minify_ctx_t *ctx)
+{
+    u_char                        *p;
+    size_t                         size;
+    ngx_chain_t                   *cl;
+    uint32_t                       hash;
+    ngx_queue_t                   *q;
+    ngx_rbtree_node_t             *node;
+    ngx_http_minify_cache_t       *cache;
+    ngx_http_minify_cache_node_t  *cn;
+
+    if (name->len > 65535) {
+        return;
+    }
+
+    cache = zone->data;
+    hash = ngx_crc32_short(name->data, name->len);
+
+    size = offsetof(ngx_rbtree_node_t, color)
+           + offsetof(ngx_http_minify_cache_node_t, data)
+           + name->len
+           + ctx->cache_len
+           + ctx->cache_gzip_len;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    cn = ngx_http_minify_cache_find(cache, name, hash);
+
+    if (cn) {
+        if (cn->uniq == of->uniq
+            && cn->mtime == of->mtime
+            && cn->size == of->size)
+        {
+            /* stored meanwhile by another worker */
+            ngx_shmtx_unlock(&cache->shpool->mutex);
+            return;
+        }
+
+        ngx_http_minify_cache_delete(cache, cn);
+    }
+
+    /* evict least recently used entries until the new one fits */
+
+    for ( ;; ) {
+        node = ngx_slab_alloc_locked(cache->shpool, size);
+
+        if (node) {
+            break;
+        }
+
+        if (ngx_queue_empty(&cache->sh->queue)) {
+            ngx_shmtx_unlock(&cache->shpool->mutex);
+
+            ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                          "could not allocate %uz bytes for \"%V\" in "
+                          "minify cache zone \"%V\"",
+                          size, name, &zone->shm.name);
+            return;
+        }
+
+        q = ngx_queue_last(&cache->sh->queue);
+        cn = ngx_queue_data(q, ngx_http_minify_cache_node_t, queue);
+
+        ngx_http_minify_cache_delete(cache, cn);
+    }
+
+    node->key = hash;
+
+    cn = (ngx_http_minify_cache_node_t *) &node->color;
+
+    cn->len = (u_short) name->len;
+    cn->count = 0;
+    cn->deleted = 0;
+    cn->uniq = of->uniq;
+    cn->mtime = of->mtime;
+    cn->size = of->size;
+    cn->data_len = ctx->cache_len;
+    cn->gzip_len = ctx->cache_gzip_len;
+
+    ngx_memcpy(cn->etag, ctx->etag, NGX_HTTP_MINIFY_ETAG_LEN);
+
+    p = ngx_cpymem(cn->data, name->data, name->len);
+
+    for (cl = ctx->cache_out; cl; cl = cl->next) {
+        p = ngx_cpymem(p, cl->buf->pos, cl->buf->last - cl->buf->pos);
+    }
+
+    /* the gzip variant follows the minified content */
+
+    for (cl = ctx->cache_gzip; cl; cl = cl->next) {
+        p = ngx_cpymem(p, cl->buf->pos, cl->buf->last - cl->buf->pos);
+    }
+
+    ngx_rbtree_insert(&cache->sh->rbtree, node);
+    ngx_queue_insert_head(&cache->sh->queue, &cn->queue);
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http minify cache store: \"%V\" %uz gzip:%uz",
+                   name, ctx->cache_len, ctx->cache_gzip_len);
+}
+
+
+static void
+ngx_http_minify_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t             **p;
+    ngx_http_minify_cache_node_t   *cn, *cnt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            cn = (ngx_http_minify_cache_node_t *) &node->color;
+            cnt = (ngx_http_minify_cache_node_t *) &temp->color;
+
+            p = (ngx_memn2cmp(cn->data, cnt->data, cn->len, cnt->len) < 0)
+                ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static ngx_int_t
+ngx_http_minify_cache_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_minify_cache_t  *ocache = data;
+
+    size_t                    len;
+    ngx_http_minify_cache_t  *cache;
+
+    cache = shm_zone->data;
+
+    if (ocache) {
+        cache->sh = ocache->sh;
+        cache->shpool = ocache->shpool;
+
+        return NGX_OK;
+    }
+
+    cache->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        cache->sh = cache->shpool->data;
+
+        return NGX_OK;
+    }
+
+    cache->sh = ngx_slab_alloc(cache->shpool,
+                               sizeof(ngx_http_minify_cache_sh_t));
+    if (cache->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->shpool->data = cache->sh;
+
+    ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
+                    ngx_http_minify_cache_rbtree_insert_value);
+
+    ngx_queue_init(&cache->sh->queue);
+
+    len = sizeof(" in minify cache zone \"\"") + shm_zone->shm.name.len;
+
+    cache->shpool->log_ctx = ngx_slab_alloc(cache->shpool, len);
+    if (cache->shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(cache->shpool->log_ctx, " in minify cache zone \"%V\"%Z",
+                &shm_zone->shm.name);
+
+    /* allocation failures are expected, entries are evicted instead */
+
+    cache->shpool->log_nomem = 0;
+
+    return NGX_OK;
+}
+
+
+/*
+ * Every location with minify and minify_metrics has a slot of counters in
+ * the zone. The slots are assigned while the configuration is merged, and
+ * a location is known by its configuration, not by its names: servers
+ * without server_name all have the same empty name, and so have the same
+ * locations of such servers. The names are only the labels of the slot,
+ * with the count of the slots with the same labels before it as the index.
+ * An "if" block is merged after its location and shares its slot.
+ */
+
+static ngx_int_t
+ngx_http_minify_metrics_slot(ngx_conf_t *cf, ngx_http_minify_conf_t *prev,
+    ngx_http_minify_conf_t *conf)
+{
+    ngx_uint_t                      i, index;
+    ngx_http_core_srv_conf_t       *cscf;
+    ngx_http_core_loc_conf_t       *clcf;
+    ngx_http_minify_metrics_t      *metrics;
+    ngx_http_minify_metrics_loc_t  *loc;
+
+    metrics = conf->metrics_zone->data;
+
+    cscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_core_module);
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+
+    if (clcf->name.len == 0) {
+        /* the http and server levels, merged before their locations */
+        return NGX_OK;
+    }
+
+    if (clcf->noname
+        && prev->metrics_zone == conf->metrics_zone
+        && prev->metrics_slot != NGX_CONF_UNSET_UINT)
+    {
+        conf->metrics_slot = prev->metrics_slot;
+        return NGX_OK;
+    }
+
+    index = 0;
+    loc = metrics->locations.elts;
+
+    for (i = 0; i < metrics->locations.nelts; i++) {
+        if (loc[i].clcf == clcf) {
+            conf->metrics_slot = i;
+            return NGX_OK;
+        }
+
+        if (ngx_memn2cmp(loc[i].server.data, cscf->server_name.data,
+                         loc[i].server.len, cscf->server_name.len)
+            == 0
+            && ngx_memn2cmp(loc[i].location.data, clcf->name.data,
+                            loc[i].location.len, clcf->name.len)
+               == 0)
+        {
+            index++;
+        }
+    }
+
+    loc = ngx_array_push(&metrics->locations);
+    if (loc == NULL) {
+        return NGX_ERROR;
+    }
+
+    loc->clcf = clcf;
+    loc->server = cscf->server_name;
+    loc->location = clcf->name;
+    loc->index = index;
+
+    conf->metrics_slot = metrics->locations.nelts - 1;
+
+    return NGX_OK;
+}
+
+
+/*
+ * A node is never freed: on reload the old workers keep adding to the
+ * nodes of their configuration until they exit. Instead a location finds
+ * its node again by its names and index, so the counters of the locations
+ * that are still there are kept and the zone only grows with new locations.
+ */
+
+static ngx_int_t
+ngx_http_minify_metrics_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    size_t                           len;
+    ngx_uint_t                       i;
+    ngx_slab_pool_t                 *shpool;
+    ngx_http_minify_metrics_t       *metrics;
+    ngx_http_minify_metrics_loc_t   *loc;
+    ngx_http_minify_metrics_node_t  *node;
+
+    metrics = shm_zone->data;
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+    metrics->shpool = shpool;
+
+    if (data == NULL && !shm_zone->shm.exists) {
+        shpool->data = NULL;
+
+        len = sizeof(" in minify metrics zone \"\"") + shm_zone->shm.name.len;
+
+        shpool->log_ctx = ngx_slab_alloc(shpool, len);
+        if (shpool->log_ctx == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_sprintf(shpool->log_ctx, " in minify metrics zone \"%V\"%Z",
+                    &shm_zone->shm.name);
+    }
+
+    loc = metrics->locations.elts;
+
+    for (i = 0; i < metrics->locations.nelts; i++) {
+
+        for (node = shpool->data; node; node = node->next) {
+            if (node->index == loc[i].index
+                && ngx_memn2cmp(node->server.data, loc[i].server.data,
+                                node->server.len, loc[i].server.len)
+                   == 0
+                && ngx_memn2cmp(node->location.data, loc[i].location.data,
+                                node->location.len, loc[i].location.len)
+                   == 0)
+            {
+                break;
+            }
+        }
+
+        if (node == NULL) {
+            node = ngx_slab_alloc(shpool,
+                                  sizeof(ngx_http_minify_metrics_node_t)
+                                  + loc[i].server.len + loc[i].location.len);
+            if (node == NULL) {
+                return NGX_ERROR;
+            }
+
+            ngx_memzero(node, sizeof(ngx_http_minify_metrics_node_t));
+
+            node->index = loc[i].index;
+
+            node->server.len = loc[i].server.len;
+            node->server.data = (u_char *) node
+                                + sizeof(ngx_http_minify_metrics_node_t);
+            ngx_memcpy(node->server.data, loc[i].server.data,
+                       loc[i].server.len);
+
+            node->location.len = loc[i].location.len;
+            node->location.data = node->server.data + node->server.len;
+            ngx_memcpy(node->location.data, loc[i].location.data,
+                       loc[i].location.len);
+
+            node->next = shpool->data;
+            shpool->data = node;
+        }
+
+        loc[i].node = node;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_http_minify_metrics_node_t *
+ngx_http_minify_metrics_node(ngx_http_minify_conf_t *conf)
+{
+    ngx_http_minify_metrics_t      *metrics;
+    ngx_http_minify_metrics_loc_t  *loc;
+
+    if (conf->metrics_zone == NULL
+        || conf->metrics_slot == NGX_CONF_UNSET_UINT)
+    {
+        return NULL;
+    }
+
+    metrics = conf->metrics_zone->data;
+    loc = metrics->locations.elts;
+
+    return loc[conf->metrics_slot].node;
+}
+
+
+/*
+ * The work of a request is added to the counters once it is over, so that
+ * a response minified in several calls of the body filter counts once.
+ */
+
+static ngx_int_t
+ngx_http_minify_log_handler(ngx_http_request_t *r)
+{
+    ngx_http_minify_ctx_t             *ctx;
+    ngx_http_minify_conf_t            *conf;
+    ngx_http_minify_metrics_node_t    *node;
+    ngx_http_minify_engine_metrics_t  *em;
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    if (!conf->enable) {
+        return NGX_OK;
+    }
+
+    node = ngx_http_minify_metrics_node(conf);
+
+    if (node == NULL) {
+        return NGX_OK;
+    }
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    if (ctx == NULL) {
+        return NGX_OK;
+    }
+
+    if (ctx->sibling) {
+        /* sent by minify_static, neither an engine nor the cache ran */
+        (void) ngx_atomic_fetch_add(
+                          &node->bypassed[NGX_HTTP_MINIFY_BYPASS_STATIC], 1);
+        return NGX_OK;
+    }
+
+    em = &node->engines[ctx->type];
+
+    (void) ngx_atomic_fetch_add(&em->requests, 1);
+
+    if (ctx->cache_status == NGX_HTTP_MINIFY_CACHE_HIT) {
+        /* the lengths of a hit are not work of the engine */
+        (void) ngx_atomic_fetch_add(&node->cache_hits, 1);
+        return NGX_OK;
+    }
+
+    (void) ngx_atomic_fetch_add(&em->bytes_in, ctx->bytes_in);
+    (void) ngx_atomic_fetch_add(&em->bytes_out, ctx->bytes_out);
+    (void) ngx_atomic_fetch_add(&em->time, ctx->time / 1000);
+
+    if (ctx->cache_status == NGX_HTTP_MINIFY_CACHE_MISS) {
+        (void) ngx_atomic_fetch_add(&node->cache_misses, 1);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_status_handler(ngx_http_request_t *r)
+{
+    size_t                          len;
+    ngx_int_t                       rc;
+    ngx_buf_t                      *b;
+    ngx_uint_t                      i;
+    ngx_chain_t                     out;
+    ngx_http_minify_conf_t         *conf;
+    ngx_http_minify_metrics_t      *metrics;
+    ngx_http_minify_metrics_loc_t  *loc;
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    metrics = conf->metrics_zone->data;
+
+    if (conf->status == NGX_HTTP_MINIFY_STATUS_JSON) {
+        ngx_str_set(&r->headers_out.content_type, "application/json");
+
+    } else {
+        ngx_str_set(&r->headers_out.content_type,
+                    "text/plain; version=0.0.4");
+    }
+
+    r->headers_out.content_type_len = r->headers_out.content_type.len;
+    r->headers_out.content_type_lowcase = NULL;
+
+    if (r->method == NGX_HTTP_HEAD) {
+        r->headers_out.status = NGX_HTTP_OK;
+
+        rc = ngx_http_send_header(r);
+
+        if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+            return rc;
+        }
+    }
+
+    /* every line has the names of the server and of the location */
+
+    len = NGX_HTTP_MINIFY_STATUS_HEADER + 2 * conf->metrics_zone->shm.name.len;
+    loc = metrics->locations.elts;
+
+    for (i = 0; i < metrics->locations.nelts; i++) {
+        len += NGX_HTTP_MINIFY_STATUS_LINES
+               * (NGX_HTTP_MINIFY_STATUS_LINE
+                  + 2 * (loc[i].server.len + loc[i].location.len));
+    }
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    if (conf->status == NGX_HTTP_MINIFY_STATUS_JSON) {
+        b->last = ngx_http_minify_status_json(b->last, conf->metrics_zone);
+
+    } else {
+        b->last = ngx_http_minify_status_prometheus(b->last,
+                                                    conf->metrics_zone);
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = b->last - b->pos;
+
+    b->last_buf = (r == r->main) ? 1 : 0;
+    b->last_in_chain = 1;
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    out.buf = b;
+    out.next = NULL;
+
+    return ngx_http_output_filter(r, &out);
+}
+
+
+static u_char *
+ngx_http_minify_status_json(u_char *p, ngx_shm_zone_t *zone)
+{
+    ngx_uint_t                         i, n;
+    ngx_http_minify_metrics_t         *metrics;
+    ngx_http_minify_metrics_loc_t     *loc;
+    ngx_http_minify_metrics_node_t    *node;
+    ngx_http_minify_engine_metrics_t  *em;
+
+    metrics = zone->data;
+    loc = metrics->locations.elts;
+
+    p = ngx_cpymem(p, "{\"zone\":\"", sizeof("{\"zone\":\"") - 1);
+    p = ngx_http_minify_escape(p, &zone->shm.name);
+    p = ngx_cpymem(p, "\",\"locations\":[", sizeof("\",\"locations\":[") - 1);
+
+    for (i = 0; i < metrics->locations.nelts; i++) {
+        node = loc[i].node;
+
+        if (i) {
+            *p++ = ',';
+        }
+
+        p = ngx_cpymem(p, "\n{\"server\":\"", sizeof("\n{\"server\":\"") - 1);
+        p = ngx_http_minify_escape(p, &loc[i].server);
+        p = ngx_cpymem(p, "\",\"location\":\"",
+                       sizeof("\",\"location\":\"") - 1);
+        p = ngx_http_minify_escape(p, &loc[i].location);
+        p = ngx_sprintf(p, "\",\"index\":%ui,\"engines\":{", loc[i].index);
+
+        for (n = 0; n < NGX_HTTP_MINIFY_ENGINES; n++) {
+            em = &node->engines[n];
+
+            p = ngx_sprintf(p, "%s\"%V\":{\"requests\":%uA,\"bytes_in\":%uA,"
+                               "\"bytes_out\":%uA,\"time_us\":%uA}",
+                            n ? "," : "", &ngx_http_minify_engines[n].name,
+                            em->requests, em->bytes_in, em->bytes_out,
+                            em->time);
+        }
+
+        p = ngx_sprintf(p, "},\"cache\":{\"hits\":%uA,\"misses\":%uA},"
+                           "\"bypassed\":{",
+                        node->cache_hits, node->cache_misses);
+
+        for (n = 0; n < NGX_HTTP_MINIFY_BYPASS_REASONS; n++) {
+            p = ngx_sprintf(p, "%s\"%V\":%uA", n ? "," : "",
+                            &ngx_http_minify_bypass_reasons[n],
+                            node->bypassed[n]);
+        }
+
+        *p++ = '}';
+        *p++ = '}';
+    }
+
+    return ngx_cpymem(p, "\n]}\n", sizeof("\n]}\n") - 1);
+}
+
+
+/*
+ * The text format of Prometheus: the samples of a metric follow its HELP
+ * and TYPE lines, with the server, the location and its index as labels.
+ */
+
+static u_char *
+ngx_http_minify_status_prometheus(u_char *p, ngx_shm_zone_t *zone)
+{
+    ngx_uint_t                         i, n;
+    ngx_atomic_uint_t                  value;
+    ngx_http_minify_metric_t          *metric;
+    ngx_http_minify_metrics_t         *metrics;
+    ngx_http_minify_metrics_loc_t     *loc;
+    ngx_http_minify_metrics_node_t    *node;
+    ngx_http_minify_engine_metrics_t  *em;
+
+    metrics = zone->data;
+    loc = metrics->locations.elts;
+
+    for (metric = ngx_http_minify_engine_metrics; metric->name; metric++) {
+
+        p = ngx_sprintf(p, "# HELP nginx_minify_%s %s\n"
+                           "# TYPE nginx_minify_%s counter\n",
+                        metric->name, metric->help, metric->name);
+
+        for (i = 0; i < metrics->locations.nelts; i++) {
+            node = loc[i].node;
+
+            for (n = 0; n < NGX_HTTP_MINIFY_ENGINES; n++) {
+                em = &node->engines[n];
+                value = *(ngx_atomic_t *) ((u_char *) em + metric->offset);
+
+                p = ngx_http_minify_status_labels(p, metric->name, &loc[i]);
+                p = ngx_sprintf(p, ",engine=\"%V\"} ",
+                                &ngx_http_minify_engines[n].name);
+
+                if (metric->offset
+                    == offsetof(ngx_http_minify_engine_metrics_t, time))
+                {
+                    /* microseconds */
+                    p = ngx_sprintf(p, "%uA.%06uA\n",
+                                    value / 1000000, value % 1000000);
+
+                } else {
+                    p = ngx_sprintf(p, "%uA\n", value);
+                }
+            }
+        }
+    }
+
+    for (metric = ngx_http_minify_cache_metrics; metric->name; metric++) {
+
+        p = ngx_sprintf(p, "# HELP nginx_minify_%s %s\n"
+                           "# TYPE nginx_minify_%s counter\n",
+                        metric->name, metric->help, metric->name);
+
+        for (i = 0; i < metrics->locations.nelts; i++) {
+            node = loc[i].node;
+            value = *(ngx_atomic_t *) ((u_char *) node + metric->offset);
+
+            p = ngx_http_minify_status_labels(p, metric->name, &loc[i]);
+            p = ngx_sprintf(p, "} %uA\n", value);
+        }
+    }
+
+    p = ngx_sprintf(p, "# HELP nginx_minify_bypassed_total Responses of "
+                       "minified types that were not minified\n"
+                       "# TYPE nginx_minify_bypassed_total counter\n");
+
+    for (i = 0; i < metrics->locations.nelts; i++) {
+        node = loc[i].node;
+
+        for (n = 0; n < NGX_HTTP_MINIFY_BYPASS_REASONS; n++) {
+            p = ngx_http_minify_status_labels(p, "bypassed_total", &loc[i]);
+            p = ngx_sprintf(p, ",reason=\"%V\"} %uA\n",
+                            &ngx_http_minify_bypass_reasons[n],
+                            node->bypassed[n]);
+        }
+    }
+
+    return p;
+}
+
+
+static u_char *
+ngx_http_minify_status_labels(u_char *p, char *name,
+    ngx_http_minify_metrics_loc_t *loc)
+{
+    p = ngx_sprintf(p, "nginx_minify_%s{server=\"", name);
+    p = ngx_http_minify_escape(p, &loc->server);
+    p = ngx_cpymem(p, "\",location=\"", sizeof("\",location=\"") - 1);
+    p = ngx_http_minify_escape(p, &loc->location);
+    p = ngx_sprintf(p, "\",index=\"%ui\"", loc->index);
+
+    return p;
+}
+
+
+/* the escaping JSON strings and Prometheus label values have in common */
+
+static u_char *
+ngx_http_minify_escape(u_char *dst, ngx_str_t *src)
+{
+    u_char  ch, *p, *last;
+
+    last = src->data + src->len;
+
+    for (p = src->data; p < last; p++) {
+        ch = *p;
+
+        if (ch == '"' || ch == '\\') {
+            *dst++ = '\\';
+            *dst++ = ch;
+
+        } else if (ch == '\n') {
+            *dst++ = '\\';
+            *dst++ = 'n';
+
+        } else if (ch < 0x20) {
+            *dst++ = ' ';
+
+        } else {
+            *dst++ = ch;
+        }
+    }
+
+    return dst;
+}
+
+
+/*
+ * minify_static serves a sibling "foo.min.js" of "foo.js" as is, the way
+ * gzip_static serves "foo.js.gz", so that files minified at build time keep
+ * the sendfile path. With "on" the sibling must not be older than the file.
+ */
+
+static ngx_int_t
+ngx_http_minify_static_handler(ngx_http_request_t *r)
+{
+    u_char                    *p, *last;
+    size_t                     root;
+    ngx_str_t                  path, source;
+    ngx_int_t                  rc;
+    ngx_uint_t                 level;
+    ngx_log_t                 *log;
+    ngx_buf_t                 *b;
+    ngx_chain_t                out;
+    ngx_open_file_info_t       of, sof;
+    ngx_http_minify_ctx_t     *ctx;
+    ngx_http_minify_conf_t    *conf;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_DECLINED;
+    }
+
+    if (r->uri.data[r->uri.len - 1] == '/' || r->exten.len == 0) {
+        return NGX_DECLINED;
+    }
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_minify_filter_module);
+
+    if (!conf->enable || conf->static_mode == NGX_HTTP_MINIFY_STATIC_OFF) {
+        return NGX_DECLINED;
+    }
+
+    if (ngx_http_set_content_type(r) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    if (ngx_http_minify_engine(r, conf) == NULL) {
+        return NGX_DECLINED;
+    }
+
+    log = r->connection->log;
+
+    last = ngx_http_map_uri_to_path(r, &source, &root, 0);
+    if (last == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    source.len = last - source.data;
+
+    /* "foo.js" -> "foo.min.js" */
+
+    path.len = source.len + sizeof("min.") - 1;
+    path.data = ngx_pnalloc(r->pool, path.len + 1);
+    if (path.data == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    p = ngx_cpymem(path.data, source.data, source.len - r->exten.len);
+    p = ngx_cpymem(p, "min.", sizeof("min.") - 1);
+    p = ngx_cpymem(p, r->exten.data, r->exten.len);
+    *p = '\0';
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "http minify static filename: \"%s\"", path.data);
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    ngx_memzero(&of, sizeof(ngx_open_file_info_t));
+
+    of.read_ahead = clcf->read_ahead;
+    of.directio = clcf->directio;
+    of.valid = clcf->open_file_cache_valid;
+    of.min_uses = clcf->open_file_cache_min_uses;
+    of.errors = clcf->open_file_cache_errors;
+    of.events = clcf->open_file_cache_events;
+
+    if (ngx_http_set_disable_symlinks(r, clcf, &path, &of) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    sof = of;
+
+    if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
+        != NGX_OK)
+    {
+        switch (of.err) {
+
+        case 0:
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+
+        case NGX_ENOENT:
+        case NGX_ENOTDIR:
+        case NGX_ENAMETOOLONG:
+
+            return NGX_DECLINED;
+
+        case NGX_EACCES:
+#if (NGX_HAVE_OPENAT)
+        case NGX_EMLINK:
+        case NGX_ELOOP:
+#endif
+
+            level = NGX_LOG_ERR;
+            break;
+
+        default:
+
+            level = NGX_LOG_CRIT;
+            break;
+        }
+
+        ngx_log_error(level, log, of.err,
+                      "%s \"%s\" failed", of.failed, path.data);
+
+        return NGX_DECLINED;
+    }
+
+    if (!of.is_file) {
+        return NGX_DECLINED;
+    }
+
+    if (conf->static_mode == NGX_HTTP_MINIFY_STATIC_ON) {
+
+        /* the minified file is stale if the source was edited after it */
+
+        sof.test_only = 1;
+
+        if (ngx_open_cached_file(clcf->open_file_cache, &source, &sof,
+                                 r->pool)
+            != NGX_OK)
+        {
+            return NGX_DECLINED;
+        }
+
+        if (of.mtime < sof.mtime) {
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                           "http minify static stale: \"%s\"", path.data);
+            return NGX_DECLINED;
+        }
+    }
+
+    r->root_tested = !r->error_page;
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    log->action = "sending response to client";
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = of.size;
+    r->headers_out.last_modified_time = of.mtime;
+
+    if (ngx_http_set_etag(r) != NGX_OK) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    r->allow_ranges = 1;
+
+    /* the file is minified already, the filter must not touch it */
+
+    ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_minify_ctx_t));
+    if (ctx == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    ctx->done = 1;
+    ctx->sibling = 1;
+
+    ngx_http_set_ctx(r, ctx, ngx_http_minify_filter_module);
+
+    b = ngx_calloc_buf(r->pool);
+    if (b == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
+    if (b->file == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    b->file_pos = 0;
+    b->file_last = of.size;
+
+    b->in_file = b->file_last ? 1 : 0;
+    b->last_buf = (r == r->main) ? 1 : 0;
+    b->last_in_chain = 1;
+
+    b->file->fd = of.fd;
+    b->file->name = path;
+    b->file->log = log;
+    b->file->directio = of.is_directio;
+
+    out.buf = b;
+    out.next = NULL;
+
+    return ngx_http_output_filter(r, &out);
+}
+
+
+static void *
+ngx_http_minify_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_minify_conf_t  *conf;
 
     conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_minify_conf_t));
     if (conf == NULL) {
         return NULL;
     }
 
-    /*
-     * set by ngx_pcalloc():
-     *
-     *     conf->bufs.num = 0;
-     *     conf->types = { NULL };
-     *     conf->types_keys = NULL;
-     */
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->bufs.num = 0;
+     *     conf->types = { NULL };
+     *     conf->types_keys = NULL;
+     */
+
+    conf->enable = NGX_CONF_UNSET;
+    conf->cache_zone = NGX_CONF_UNSET_PTR;
+    conf->cache_path = NGX_CONF_UNSET_PTR;
+    conf->static_mode = NGX_CONF_UNSET_UINT;
+    conf->mmap = NGX_CONF_UNSET;
+    conf->exact_length = NGX_CONF_UNSET_SIZE;
+    conf->min_length = NGX_CONF_UNSET;
+    conf->max_length = NGX_CONF_UNSET;
+    conf->css_engine = NGX_CONF_UNSET_UINT;
+    conf->cache_gzip = NGX_CONF_UNSET;
+    conf->metrics_zone = NGX_CONF_UNSET_PTR;
+    conf->metrics_slot = NGX_CONF_UNSET_UINT;
+#if (NGX_THREADS)
+    conf->thread_pool = NGX_CONF_UNSET_PTR;
+    conf->thread_threshold = NGX_CONF_UNSET_SIZE;
+#endif
+
+    return conf;
+}
+
+
+static char *
+ngx_http_minify_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_minify_conf_t *prev = parent;
+    ngx_http_minify_conf_t *conf = child;
+
+    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+    ngx_conf_merge_bufs_value(conf->bufs, prev->bufs,
+                              (128 * 1024) / ngx_pagesize, ngx_pagesize);
+
+    if (conf->bufs.size < NGX_HTTP_MINIFY_MIN_SIZE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"minify_buffers\" size must be at least %uz",
+                           (size_t) NGX_HTTP_MINIFY_MIN_SIZE);
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_conf_merge_ptr_value(conf->cache_zone, prev->cache_zone, NULL);
+    ngx_conf_merge_ptr_value(conf->cache_path, prev->cache_path, NULL);
+    ngx_conf_merge_uint_value(conf->static_mode, prev->static_mode,
+                              NGX_HTTP_MINIFY_STATIC_OFF);
+    ngx_conf_merge_value(conf->mmap, prev->mmap, 0);
+    ngx_conf_merge_size_value(conf->exact_length, prev->exact_length,
+                              NGX_HTTP_MINIFY_EXACT_LENGTH);
+    ngx_conf_merge_off_value(conf->min_length, prev->min_length, 0);
+    ngx_conf_merge_off_value(conf->max_length, prev->max_length, 0);
+    ngx_conf_merge_uint_value(conf->css_engine, prev->css_engine,
+                              NGX_CSSMIN_SCAN);
+    ngx_conf_merge_value(conf->cache_gzip, prev->cache_gzip, 0);
+    ngx_conf_merge_ptr_value(conf->metrics_zone, prev->metrics_zone, NULL);
+
+    if (conf->metrics_zone && conf->enable) {
+        if (ngx_http_minify_metrics_slot(cf, prev, conf) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    if (conf->status && conf->metrics_zone == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"minify_status\" requires \"minify_metrics\"");
+        return NGX_CONF_ERROR;
+    }
+
+#if !(NGX_HTTP_GZIP && NGX_ZLIB)
+    if (conf->cache_gzip) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"minify_cache_gzip\" is unsupported, "
+                           "nginx was built without gzip");
+        return NGX_CONF_ERROR;
+    }
+#endif
+
+#if (NGX_THREADS)
+    ngx_conf_merge_ptr_value(conf->thread_pool, prev->thread_pool, NULL);
+    ngx_conf_merge_size_value(conf->thread_threshold, prev->thread_threshold,
+                              NGX_HTTP_MINIFY_THREAD_THRESHOLD);
+#endif
+
+    if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
+                             &prev->types_keys, &prev->types,
+                             ngx_http_minify_default_types)
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+/*
+ * Like ngx_http_types_slot(), but a type may be given as "type=engine" and
+ * the value of each type in the hash is its engine.
+ */
+
+static char *
+ngx_http_minify_types(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_minify_conf_t *mcf = conf;
+
+    u_char                    *p;
+    ngx_str_t                 *value, *default_type, name;
+    ngx_uint_t                 i, n, hash;
+    ngx_hash_key_t            *type;
+    ngx_http_minify_engine_t  *engine;
+
+    if (mcf->types_keys == (void *) -1) {
+        return NGX_CONF_OK;
+    }
+
+    if (mcf->types_keys == NULL) {
+        mcf->types_keys = ngx_array_create(cf->temp_pool, 1,
+                                           sizeof(ngx_hash_key_t));
+        if (mcf->types_keys == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        for (default_type = cmd->post; default_type->len; default_type++) {
+            type = ngx_array_push(mcf->types_keys);
+            if (type == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            type->key = *default_type;
+            type->key_hash = ngx_hash_key(default_type->data,
+                                          default_type->len);
+            type->value = ngx_http_minify_find_engine(default_type->data,
+                                                      default_type->len);
+        }
+    }
+
+    value = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (value[i].len == 1 && value[i].data[0] == '*') {
+            mcf->types_keys = (void *) -1;
+            return NGX_CONF_OK;
+        }
+
+        p = ngx_strlchr(value[i].data, value[i].data + value[i].len, '=');
+
+        if (p) {
+            name.data = p + 1;
+            name.len = value[i].data + value[i].len - name.data;
+
+            value[i].len = p - value[i].data;
+
+            for (engine = ngx_http_minify_engines; engine->name.len; engine++)
+            {
+                if (engine->name.len == name.len
+                    && ngx_strncmp(engine->name.data, name.data, name.len)
+                       == 0)
+                {
+                    break;
+                }
+            }
+
+            if (engine->name.len == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "unknown minify engine \"%V\"", &name);
+                return NGX_CONF_ERROR;
+            }
+
+        } else {
+            engine = ngx_http_minify_find_engine(value[i].data, value[i].len);
+
+            if (engine == NULL) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "no minify engine for MIME type \"%V\", "
+                                   "use \"%V=engine\"", &value[i], &value[i]);
+                return NGX_CONF_ERROR;
+            }
+        }
+
+        hash = ngx_hash_strlow(value[i].data, value[i].data, value[i].len);
+        value[i].data[value[i].len] = '\0';
+
+        type = mcf->types_keys->elts;
+        for (n = 0; n < mcf->types_keys->nelts; n++) {
+
+            if (ngx_strcmp(value[i].data, type[n].key.data) == 0) {
+                /* a later engine replaces the one set before */
+                type[n].value = engine;
+                goto next;
+            }
+        }
+
+        type = ngx_array_push(mcf->types_keys);
+        if (type == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        type->key = value[i];
+        type->key_hash = hash;
+        type->value = engine;
+
+    next:
+
+        continue;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_minify_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_minify_conf_t *mcf = conf;
+
+    u_char                   *p;
+    ssize_t                   size;
+    ngx_str_t                *value, name, s;
+    ngx_http_minify_cache_t  *cache;
+
+    if (mcf->cache_zone != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        mcf->cache_zone = NULL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[1].data, "zone=", 5) != 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    name.data = value[1].data + 5;
+
+    p = (u_char *) ngx_strchr(name.data, ':');
+
+    if (p) {
+        name.len = p - name.data;
+
+        s.data = p + 1;
+        s.len = value[1].data + value[1].len - s.data;
+
+        size = ngx_parse_size(&s);
+
+        if (size == NGX_ERROR) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid zone size \"%V\"", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+        if (size < (ssize_t) (8 * ngx_pagesize)) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "zone \"%V\" is too small", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+    } else {
+        name.len = value[1].len - 5;
+        size = 0;
+    }
+
+    if (name.len == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone name \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    mcf->cache_zone = ngx_shared_memory_add(cf, &name, size,
+                                            &ngx_http_minify_filter_module);
+    if (mcf->cache_zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (mcf->cache_zone->data == NULL) {
+        cache = ngx_pcalloc(cf->pool, sizeof(ngx_http_minify_cache_t));
+        if (cache == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        mcf->cache_zone->init = ngx_http_minify_cache_init_zone;
+        mcf->cache_zone->data = cache;
+
+    } else if (mcf->cache_zone->init != ngx_http_minify_cache_init_zone) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "zone \"%V\" is already used by minify_metrics",
+                           &name);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
 
-    conf->enable = NGX_CONF_UNSET;
 
-    return conf;
+static char *
+ngx_http_minify_cache_path(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_minify_conf_t *mcf = conf;
+
+    off_t                          max_size;
+    u_char                        *last, *p;
+    ngx_str_t                     *value, s;
+    ngx_uint_t                     i, n;
+    ngx_path_t                    *path;
+    ngx_http_minify_cache_path_t  *cp;
+
+    if (mcf->cache_path != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid parameter \"%V\"", &value[2]);
+            return NGX_CONF_ERROR;
+        }
+
+        mcf->cache_path = NULL;
+        return NGX_CONF_OK;
+    }
+
+    path = ngx_pcalloc(cf->pool, sizeof(ngx_path_t));
+    if (path == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    path->name = value[1];
+
+    if (path->name.data[path->name.len - 1] == '/') {
+        path->name.len--;
+    }
+
+    if (ngx_conf_full_name(cf->cycle, &path->name, 0) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    max_size = 0;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "levels=", 7) == 0) {
+
+            p = value[i].data + 7;
+            last = value[i].data + value[i].len;
+
+            for (n = 0; n < NGX_MAX_PATH_LEVEL && p < last; n++) {
+
+                if (*p > '0' && *p < '3') {
+
+                    path->level[n] = *p++ - '0';
+                    path->len += path->level[n] + 1;
+
+                    if (p == last) {
+                        break;
+                    }
+
+                    if (*p++ == ':' && n < NGX_MAX_PATH_LEVEL - 1
+                        && p < last)
+                    {
+                        continue;
+                    }
+
+                    goto invalid_levels;
+                }
+
+                goto invalid_levels;
+            }
+
+            if (path->len < 10 + NGX_MAX_PATH_LEVEL) {
+                continue;
+            }
+
+        invalid_levels:
+
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid \"levels\" \"%V\"", &value[i]);
+            return NGX_CONF_ERROR;
+        }
+
+        if (ngx_strncmp(value[i].data, "max_size=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            max_size = ngx_parse_offset(&s);
+            if (max_size < 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid max_size value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    cp = ngx_pcalloc(cf->pool, sizeof(ngx_http_minify_cache_path_t));
+    if (cp == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    cp->max_size = max_size;
+
+    if (max_size) {
+        path->manager = ngx_http_minify_cache_manager;
+        path->data = cp;
+    }
+
+    path->conf_file = cf->conf_file->file.name.data;
+    path->line = cf->conf_file->line;
+
+    if (ngx_add_path(cf, &path) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    cp->path = path;
+    mcf->cache_path = cp;
+
+    return NGX_CONF_OK;
 }
 
 
 static char *
-ngx_http_minify_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+ngx_http_minify_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
-    ngx_http_minify_conf_t *prev = parent;
-    ngx_http_minify_conf_t *conf = child;
+#if (NGX_THREADS)
+    ngx_http_minify_conf_t *mcf = conf;
 
-    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+    ssize_t      size;
+    ngx_str_t   *value, s;
+    ngx_uint_t   i;
 
-    if (ngx_http_merge_types(cf, &conf->types_keys, &conf->types,
-                             &prev->types_keys, &prev->types,
-                             ngx_http_minify_default_types)
-        != NGX_OK)
-    {
+    if (mcf->thread_pool != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+
+        if (cf->args->nelts > 2) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid parameter \"%V\"", &value[2]);
+            return NGX_CONF_ERROR;
+        }
+
+        mcf->thread_pool = NULL;
+        return NGX_CONF_OK;
+    }
+
+    mcf->thread_pool = ngx_thread_pool_add(cf, &value[1]);
+    if (mcf->thread_pool == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "threshold=", 10) == 0) {
+
+            s.len = value[i].len - 10;
+            s.data = value[i].data + 10;
+
+            size = ngx_parse_size(&s);
+
+            if (size == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid threshold \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            mcf->thread_threshold = (size_t) size;
+
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+
+#else
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "\"minify_thread_pool\" is unsupported, "
+                       "nginx was built without threads");
+
+    return NGX_CONF_ERROR;
+
+#endif
+}
+
+
+static char *
+ngx_http_minify_metrics(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_minify_conf_t *mcf = conf;
+
+    u_char                     *p;
+    ssize_t                     size;
+    ngx_str_t                  *value, name, s;
+    ngx_http_minify_metrics_t  *metrics;
+
+    if (mcf->metrics_zone != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        mcf->metrics_zone = NULL;
+        return NGX_CONF_OK;
+    }
+
+    if (ngx_strncmp(value[1].data, "zone=", 5) != 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    name.data = value[1].data + 5;
+
+    p = (u_char *) ngx_strchr(name.data, ':');
+
+    if (p) {
+        name.len = p - name.data;
+
+        s.data = p + 1;
+        s.len = value[1].data + value[1].len - s.data;
+
+        size = ngx_parse_size(&s);
+
+        if (size == NGX_ERROR) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid zone size \"%V\"", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+        if (size < (ssize_t) (8 * ngx_pagesize)) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "zone \"%V\" is too small", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+    } else {
+        name.len = value[1].len - 5;
+        size = 0;
+    }
+
+    if (name.len == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone name \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    mcf->metrics_zone = ngx_shared_memory_add(cf, &name, size,
+                                              &ngx_http_minify_filter_module);
+    if (mcf->metrics_zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (mcf->metrics_zone->data == NULL) {
+        metrics = ngx_pcalloc(cf->pool, sizeof(ngx_http_minify_metrics_t));
+        if (metrics == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        if (ngx_array_init(&metrics->locations, cf->pool, 4,
+                           sizeof(ngx_http_minify_metrics_loc_t))
+            != NGX_OK)
+        {
+            return NGX_CONF_ERROR;
+        }
+
+        mcf->metrics_zone->init = ngx_http_minify_metrics_init_zone;
+        mcf->metrics_zone->data = metrics;
+
+    } else if (mcf->metrics_zone->init != ngx_http_minify_metrics_init_zone) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "zone \"%V\" is already used by minify_cache",
+                           &name);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_minify_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_minify_conf_t *mcf = conf;
+
+    ngx_str_t                 *value;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    if (mcf->status) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (cf->args->nelts == 1 || ngx_strcmp(value[1].data, "json") == 0) {
+        mcf->status = NGX_HTTP_MINIFY_STATUS_JSON;
+
+    } else if (ngx_strcmp(value[1].data, "prometheus") == 0) {
+        mcf->status = NGX_HTTP_MINIFY_STATUS_PROMETHEUS;
+
+    } else {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[1]);
         return NGX_CONF_ERROR;
     }
 
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_minify_status_handler;
+
     return NGX_CONF_OK;
 }
 
 
+/*
+ * The variables tell the work of the engine for the response, so that it
+ * may be logged; they are not found when the response was not minified.
+ */
+
+static ngx_int_t
+ngx_http_minify_bytes_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char                 *p;
+    ngx_http_minify_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    if (ctx == NULL || ctx->sibling) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    p = ngx_pnalloc(r->pool, NGX_OFF_T_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    v->len = ngx_sprintf(p, "%O", *(off_t *) ((char *) ctx + data)) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
+/* the original size by the minified one, as $gzip_ratio */
+
+static ngx_int_t
+ngx_http_minify_ratio_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    ngx_uint_t              zint, zfrac;
+    ngx_http_minify_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    if (ctx == NULL || ctx->sibling || ctx->bytes_in == 0
+        || ctx->bytes_out == 0)
+    {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    v->data = ngx_pnalloc(r->pool, NGX_INT32_LEN + 3);
+    if (v->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    zint = (ngx_uint_t) (ctx->bytes_in / ctx->bytes_out);
+    zfrac = (ngx_uint_t) ((ctx->bytes_in * 100 / ctx->bytes_out) % 100);
+
+    if ((ctx->bytes_in * 1000 / ctx->bytes_out) % 10 > 4) {
+
+        /* the rounding, e.g., 2.125 to 2.13 */
+
+        zfrac++;
+
+        if (zfrac > 99) {
+            zint++;
+            zfrac = 0;
+        }
+    }
+
+    v->len = ngx_sprintf(v->data, "%ui.%02ui", zint, zfrac) - v->data;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_time_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    u_char                 *p;
+    ngx_http_minify_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    if (ctx == NULL || ctx->sibling) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    p = ngx_pnalloc(r->pool, NGX_INT64_LEN);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    v->len = ngx_sprintf(p, "%uL", ctx->time / 1000) - p;
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+    v->data = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_cache_status_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    ngx_http_minify_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_minify_filter_module);
+
+    if (ctx == NULL || ctx->sibling || ctx->cache_status == 0) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    if (ctx->cache_status == NGX_HTTP_MINIFY_CACHE_HIT) {
+        ngx_str_set(v, "HIT");
+
+    } else {
+        ngx_str_set(v, "MISS");
+    }
+
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_minify_add_variables(ngx_conf_t *cf)
+{
+    ngx_http_variable_t  *var, *v;
+
+    for (v = ngx_http_minify_vars; v->name.len; v++) {
+        var = ngx_http_add_variable(cf, &v->name, v->flags);
+        if (var == NULL) {
+            return NGX_ERROR;
+        }
+
+        var->get_handler = v->get_handler;
+        var->data = v->data;
+    }
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_minify_filter_init(ngx_conf_t *cf)
 {
+    ngx_http_handler_pt        *h;
+    ngx_http_core_main_conf_t  *cmcf;
+
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_CONTENT_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_minify_static_handler;
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_LOG_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_minify_log_handler;
+
     ngx_http_next_header_filter = ngx_http_top_header_filter;
     ngx_http_top_header_filter = ngx_http_minify_header_filter;
 
@@ -420,6 +4970,3 @@ ngx_http_minify_filter_init(ngx_conf_t *cf)
 
     return NGX_OK;
 }
-
-
-
@@ -29,121 +29,237 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <ngx_core.h>
+#include "ngx_jsmin.h"
 
+#if (__SSE2__)
+#include <emmintrin.h>
+#endif
 
-static int   theA, theB, theLookahead = EOF, theX = EOF, theY = EOF;
 
-static int ngx_getc(ngx_buf_t *in)
-{
-    if (in->pos > in->end) {
-        return EOF;
-    }
-    u_char c = in->pos[0];
-    ++in->pos;
-    return c;
-}
+/*
+ * The minifier is a push parser: jsmin() may be called with any split of
+ * the input and keeps everything it needs to resume in ngx_jsmin_t, so
+ * tokens spanning buffer boundaries are handled like in a single buffer.
+ * The states below correspond to the places where the original pull
+ * implementation called get().
+ */
+
+enum {
+    sw_start = 0,
+    sw_bom,
+    sw_next,
+    sw_slash,
+    sw_line_comment,
+    sw_block_comment,
+    sw_block_comment_star,
+    sw_string,
+    sw_string_escape,
+    sw_regexp,
+    sw_regexp_escape,
+    sw_regexp_class,
+    sw_regexp_class_escape,
+    sw_done
+};
+
+
+#define ngx_putc(c, out)  *(out)->last++ = (u_char) (c)
+
+
+/*
+ * The classes of the input bytes:
+ *
+ *   ALNUM  a letter, digit, underscore, dollar sign, backslash or non-ASCII
+ *          character, see isAlphanum();
+ *   SPACE  a byte translated to a space or linefeed by get();
+ *   PLAIN  a byte that is not a space, slash or quote: between other plain
+ *          bytes it is copied as is.
+ */
+
+#define NGX_JSMIN_ALNUM  0x01
+#define NGX_JSMIN_SPACE  0x02
+#define NGX_JSMIN_PLAIN  0x04
+
+static const u_char  ngx_jsmin_class[256] = {
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 4, 0, 4, 5, 4, 4, 0, 4, 4, 4, 4, 4, 4, 4, 0,    /*  !"#$%&'()*+,-./ */
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 4, 4, 4, 4, 4, 4,    /* 0123456789:;<=>? */
+    4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,    /* @ABCDEFGHIJKLMNO */
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 4, 5, 4, 4, 5,    /* PQRSTUVWXYZ[\]^_ */
+    0, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,    /* `abcdefghijklmno */
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 4, 4, 4, 4, 5,    /* pqrstuvwxyz{|}~  */
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
+};
 
-static void ngx_putc(u_char c,ngx_buf_t *out)
-{
-    if(out->pos <= out->end) {
-        out->pos[0] = c;
-        ++out->pos;
-    }
-}
 
 /* 
  * isAlphanum -- return true if the character is a letter, digit, underscore,
  * dollar sign, or non-ASCII character.
  */
 
-static int isAlphanum(int c)
-{
-    return ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') 
-            || (c >= 'A' && c <= 'Z') || c == '_' || c == '$' || c == '\\' 
-            || c > 126);
-}
+#define isAlphanum(c)                                                        \
+    ((c) != EOF && (ngx_jsmin_class[(c)] & NGX_JSMIN_ALNUM))
 
 
-/* 
- * get -- return the next character from stdin. Watch out for lookahead. If
- * the character is a control character, translate it to a space or
- * linefeed.
+/*
+ * scan_plain, scan_space, scan_eol, scan_literal -- return the first byte
+ * before last that is not plain, that is not a space, that ends a line
+ * comment, or that is one of c1, c2, c3 or a control character which get()
+ * would translate. With SSE2 the bytes are tested 16 at a time.
  */
 
-static int get(ngx_buf_t *in)
+static u_char *scan_plain(u_char *p, u_char *last)
 {
-    int c = theLookahead;
-    theLookahead = EOF;
+#if (__SSE2__)
+    int      mask;
+    __m128i  v, m;
 
-    if (c == EOF) {
-        c = ngx_getc(in);
-    }
-    if (c >= ' ' || c == '\n' || c == EOF) {
-        return c;
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        /* bytes below 0x21, compared as signed after flipping the sign */
+
+        m = _mm_cmplt_epi8(_mm_xor_si128(v, _mm_set1_epi8((char) 0x80)),
+                           _mm_set1_epi8((char) (0x21 ^ 0x80)));
+
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('`')));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
     }
-    if (c == '\r') {
-        return '\n';
+#endif
+
+    while (p < last && (ngx_jsmin_class[*p] & NGX_JSMIN_PLAIN)) {
+        p++;
     }
-    return ' ';
-}
 
+    return p;
+}
 
-/* 
- * peek -- get the next character without getting it.
- */
 
-static int peek(ngx_buf_t *in)
+static u_char *scan_space(u_char *p, u_char *last)
 {
-    theLookahead = get(in);
-    return theLookahead;
+#if (__SSE2__)
+    int      mask;
+    __m128i  v, m;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        m = _mm_cmpgt_epi8(_mm_xor_si128(v, _mm_set1_epi8((char) 0x80)),
+                           _mm_set1_epi8((char) (0x20 ^ 0x80)));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+#endif
+
+    while (p < last && (ngx_jsmin_class[*p] & NGX_JSMIN_SPACE)) {
+        p++;
+    }
+
+    return p;
 }
 
 
-/*
- * next -- get the next character, excluding comments. peek() is used to see
- * if a '/' is followed by a '/' or '*'.
- */
+static u_char *scan_eol(u_char *p, u_char *last)
+{
+#if (__SSE2__)
+    int      mask;
+    __m128i  v, m;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+#endif
 
-static int next(ngx_buf_t *in)
+    while (p < last && *p != '\n' && *p != '\r') {
+        p++;
+    }
+
+    return p;
+}
+
+
+static u_char *scan_literal(u_char *p, u_char *last, u_char c1, u_char c2,
+    u_char c3)
 {
-    int c = get(in);
-    if  (c == '/') {
-        switch (peek(in)) {
+#if (__SSE2__)
+    int      mask;
+    __m128i  v, m;
 
-        case '/':
-            for (;;) {
-                c = get(in);
-                if (c <= '\n') {
-                    break;
-                }
-            }
-            break;
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
 
-        case '*':
-            get(in);
-            while (c != ' ') {
-                switch (get(in)) {
-
-                case '*':
-                    if (peek(in) == '/') {
-                        get(in);
-                        c = ' ';
-                    }
-                    break;
-
-                case EOF:
-                    break; /* Unterminated comment. */
-                }
-            }
+        m = _mm_cmplt_epi8(_mm_xor_si128(v, _mm_set1_epi8((char) 0x80)),
+                           _mm_set1_epi8((char) (' ' ^ 0x80)));
 
-            break;
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c1)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c2)));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8((char) c3)));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
         }
+
+        p += 16;
     }
+#endif
 
-    theY = theX;
-    theX = c;
+    while (p < last && *p >= ' ' && *p != c1 && *p != c2 && *p != c3) {
+        p++;
+    }
 
-    return c;
+    return p;
+}
+
+
+/* 
+ * get -- translate a control character to a space or linefeed.
+ */
+
+static int get(int c)
+{
+    if (c >= ' ' || c == '\n' || c == EOF) {
+        return c;
+    }
+    if (c == '\r') {
+        return '\n';
+    }
+    return ' ';
 }
 
 
@@ -153,183 +269,569 @@ static int next(ngx_buf_t *in)
  *       2   Copy B to A. Get the next B. (Delete A).
  *       3   Get the next B. (Delete B).
  *  action treats a string as a single character. Wow!
- *  action recognizes a regular expression if it is preceded by ( or , or =.
+ *  Getting the next B is left to the caller: action only sets the state
+ *  in which the following input will be read.
 */
 
-static void action(int d,ngx_buf_t *in,ngx_buf_t *out)
+static void action(ngx_jsmin_t *ctx, int d, ngx_buf_t *out)
 {
     switch (d) {
 
     case 1:
-        ngx_putc(theA, out);
-        if ((theY == '\n' || theY == ' ') 
-            && (theA == '+' || theA == '-' || theA == '*' || theA == '/') 
-            && (theB == '+' || theB == '-' || theB == '*' || theB == '/'))
+        ngx_putc(ctx->a, out);
+        if ((ctx->y == '\n' || ctx->y == ' ') 
+            && (ctx->a == '+' || ctx->a == '-' || ctx->a == '*'
+                || ctx->a == '/') 
+            && (ctx->b == '+' || ctx->b == '-' || ctx->b == '*'
+                || ctx->b == '/'))
         {
-            ngx_putc(theY, out);
+            ngx_putc(ctx->y, out);
         }
 
+        /* fall through */
+
     case 2:
-        theA = theB;
-        if (theA == '\'' || theA == '"' || theA == '`') {
-            for (;;) {
-                ngx_putc(theA, out);
-                theA = get(in);
-                if (theA == theB) {
-                    break;
-                }
-                if (theA == '\\') {
-                    ngx_putc(theA, out);
-                    theA = get(in);
-                }
-                if (theA == EOF) {
-                    break; /* Unterminated string literal. */
-                }
-            }
+        ctx->a = ctx->b;
+        if (ctx->a == '\'' || ctx->a == '"' || ctx->a == '`') {
+            ngx_putc(ctx->a, out);
+            ctx->state = sw_string;
+            return;
         }
 
-    case 3:
-        theB = next(in);
-        if (theB == '/' && (
-            theA == '(' || theA == ',' || theA == '=' || theA == ':' 
-            || theA == '[' || theA == '!' || theA == '&' || theA == '|' 
-            || theA == '?' || theA == '+' || theA == '-' || theA == '~' 
-            || theA == '*' || theA == '/' || theA == '\n'))
-        {
-            ngx_putc(theA, out);
-            if (theA == '/' || theA == '*') {
-                ngx_putc(' ', out);
-            }
-
-            ngx_putc(theB, out);
-
-            for (;;) {
-                theA = get(in);
-                if (theA == '[') {
-                    for (;;) {
-                        ngx_putc(theA, out);
-                        theA = get(in);
-                        if (theA == ']') {
-                            break;
-                        }
-                        if (theA == '\\') {
-                            ngx_putc(theA, out);
-                            theA = get(in);
-                        }
-                        if (theA == EOF) {
-                            break; /* Unterminated set in Regular Expression literal.*/
-                        }
-                    }
-
-                } else if (theA == '/') {
-                    switch (peek(in)) {
-                    case '/':
-                    case '*':
-                         break; /* Unterminated set in Regular Expression literal.*/
-                    }
-
-                    break;
-
-                } else if (theA =='\\') {
-                    ngx_putc(theA, out);
-                    theA = get(in);
-                }
-                if (theA == EOF) {
-                    break; /* Unterminated Regular Expression literal.*/
-                }
-
-                ngx_putc(theA, out);
-            }
+        /* fall through */
 
-            theB = next(in);
-        }
+    case 3:
+        ctx->state = sw_next;
     }
 }
 
 
 /* 
- *  jsmin -- Copy the input to the output, deleting the characters which are
- *  insignificant to JavaScript. Comments will be removed. Tabs will be
- *  replaced with spaces. Carriage returns will be replaced with linefeeds.
- *  Most spaces and linefeeds will be removed.
+ *  loop -- decide what to do with A and B, the body of the main loop of
+ *  the original jsmin.
 */
 
-void jsmin(ngx_buf_t *in,ngx_buf_t *out)
+static void loop(ngx_jsmin_t *ctx, ngx_buf_t *out)
 {
-    if (peek(in) == 0xEF) {
-        get(in);
-        get(in);
-        get(in);
+    if (ctx->a == EOF) {
+        ctx->state = sw_done;
+        return;
     }
 
-    theA = '\n';
-    action(3,in,out);
-    while (theA != EOF) {
-        switch (theA) {
+    switch (ctx->a) {
+
+    case ' ':
+        action(ctx, isAlphanum(ctx->b) ? 1 : 2, out);
+        break;
+
+    case '\n':
+        switch (ctx->b) {
+
+        case '{':
+        case '[':
+        case '(':
+        case '+':
+        case '-':
+        case '!':
+        case '~':
+            action(ctx, 1, out);
+            break;
 
         case ' ':
-            action(isAlphanum(theB) ? 1 : 2,in,out);
+            action(ctx, 3, out);
+            break;
+
+        default:
+            action(ctx, isAlphanum(ctx->b) ? 1 : 2, out);
+        }
+        break;
+
+    default:
+        switch (ctx->b) {
+
+        case ' ':
+            action(ctx, isAlphanum(ctx->a) ? 1 : 3, out);
             break;
 
         case '\n':
-            switch (theB) {
+            switch (ctx->a) {
 
-            case '{':
-            case '[':
-            case '(':
+            case '}':
+            case ']':
+            case ')':
             case '+':
             case '-':
-            case '!':
-            case '~':
-                action(1,in,out);
-                break;
-
-            case ' ':
-                action(3,in,out);
+            case '"':
+            case '\'':
+            case '`':
+                action(ctx, 1, out);
                 break;
 
             default:
-                action(isAlphanum(theB) ? 1 : 2,in,out);
+                action(ctx, isAlphanum(ctx->a) ? 1 : 3, out);
             }
             break;
 
         default:
-            switch (theB) {
+            action(ctx, 1, out);
+            break;
+        }
+    }
+}
 
-            case ' ':
-                action(isAlphanum(theA) ? 1 : 3,in,out);
-                break;
 
-            case '\n':
-                switch (theA) {
-
-                case '}':
-                case ']':
-                case ')':
-                case '+':
-                case '-':
-                case '"':
-                case '\'':
-                case '`':
-                    action(1,in,out);
-                    break;
-
-                default:
-                    action(isAlphanum(theA) ? 1 : 3,in,out);
-                }
-                break;
+/*
+ * next -- accept the next character with comments removed as the new B.
+ * A regular expression literal is recognized if B is a '/' preceded by
+ * ( or , or = and similar.
+ */
 
-            default:
-                action(1,in,out);
-                break;
+static void next(ngx_jsmin_t *ctx, int c, ngx_buf_t *out)
+{
+    ctx->y = ctx->x;
+    ctx->x = c;
+    ctx->b = c;
+
+    if (ctx->regexp) {
+        /* the character after a regular expression literal */
+        ctx->regexp = 0;
+        loop(ctx, out);
+        return;
+    }
+
+    if (ctx->b == '/' && (
+        ctx->a == '(' || ctx->a == ',' || ctx->a == '=' || ctx->a == ':' 
+        || ctx->a == '[' || ctx->a == '!' || ctx->a == '&' || ctx->a == '|' 
+        || ctx->a == '?' || ctx->a == '+' || ctx->a == '-' || ctx->a == '~' 
+        || ctx->a == '*' || ctx->a == '/' || ctx->a == '\n'))
+    {
+        ngx_putc(ctx->a, out);
+        if (ctx->a == '/' || ctx->a == '*') {
+            ngx_putc(' ', out);
+        }
+
+        ngx_putc(ctx->b, out);
+
+        ctx->state = sw_regexp;
+        return;
+    }
+
+    loop(ctx, out);
+}
+
+
+/*
+ * regexp_end -- the regular expression literal is over, the character that
+ * follows it is the next B.
+ */
+
+static void regexp_end(ngx_jsmin_t *ctx, int c)
+{
+    ctx->a = c;
+    ctx->regexp = 1;
+    ctx->state = sw_next;
+}
+
+
+/*
+ * step -- feed one character to the minifier. Returns 0 if the character
+ * has to be fed again because it was only peeked at.
+ */
+
+static ngx_uint_t step(ngx_jsmin_t *ctx, int c, ngx_buf_t *out)
+{
+    switch (ctx->state) {
+
+    case sw_start:
+        if (c == 0xEF) {
+            ctx->bom = 2;
+            ctx->state = sw_bom;
+            return 1;
+        }
+
+        ctx->state = sw_next;
+        return 0;
+
+    case sw_bom:
+        if (c == EOF || --ctx->bom == 0) {
+            ctx->state = sw_next;
+            return c != EOF;
+        }
+
+        return 1;
+
+    case sw_next:
+        if (c == '/') {
+            ctx->state = sw_slash;
+            return 1;
+        }
+
+        next(ctx, c, out);
+        return 1;
+
+    case sw_slash:
+        switch (c) {
+
+        case '/':
+            ctx->state = sw_line_comment;
+            return 1;
+
+        case '*':
+            ctx->state = sw_block_comment;
+            return 1;
+        }
+
+        next(ctx, '/', out);
+        return 0;
+
+    case sw_line_comment:
+        if (c <= '\n') {
+            next(ctx, c, out);
+        }
+
+        return 1;
+
+    case sw_block_comment:
+        switch (c) {
+
+        case '*':
+            ctx->state = sw_block_comment_star;
+            break;
+
+        case EOF:
+            next(ctx, EOF, out); /* Unterminated comment. */
+            break;
+        }
+
+        return 1;
+
+    case sw_block_comment_star:
+        switch (c) {
+
+        case '/':
+            next(ctx, ' ', out);
+            break;
+
+        case '*':
+            break;
+
+        case EOF:
+            next(ctx, EOF, out); /* Unterminated comment. */
+            break;
+
+        default:
+            ctx->state = sw_block_comment;
+        }
+
+        return 1;
+
+    case sw_string:
+        if (c == ctx->b) {
+            ctx->a = c;
+            ctx->state = sw_next;
+
+        } else if (c == '\\') {
+            ngx_putc(c, out);
+            ctx->state = sw_string_escape;
+
+        } else if (c == EOF) {
+            ctx->a = EOF; /* Unterminated string literal. */
+            ctx->state = sw_next;
+
+        } else {
+            ngx_putc(c, out);
+        }
+
+        return 1;
+
+    case sw_string_escape:
+        if (c == EOF) {
+            ctx->a = EOF; /* Unterminated string literal. */
+            ctx->state = sw_next;
+            return 1;
+        }
+
+        ngx_putc(c, out);
+        ctx->state = sw_string;
+        return 1;
+
+    case sw_regexp:
+        switch (c) {
+
+        case '[':
+            ngx_putc(c, out);
+            ctx->state = sw_regexp_class;
+            break;
+
+        case '/':
+            regexp_end(ctx, c);
+            break;
+
+        case '\\':
+            ngx_putc(c, out);
+            ctx->state = sw_regexp_escape;
+            break;
+
+        case EOF:
+            regexp_end(ctx, EOF); /* Unterminated Regular Expression literal.*/
+            break;
+
+        default:
+            ngx_putc(c, out);
+        }
+
+        return 1;
+
+    case sw_regexp_escape:
+        if (c == EOF) {
+            regexp_end(ctx, EOF); /* Unterminated Regular Expression literal.*/
+            return 1;
+        }
+
+        ngx_putc(c, out);
+        ctx->state = sw_regexp;
+        return 1;
+
+    case sw_regexp_class:
+        switch (c) {
+
+        case ']':
+            ngx_putc(c, out);
+            ctx->state = sw_regexp;
+            break;
+
+        case '\\':
+            ngx_putc(c, out);
+            ctx->state = sw_regexp_class_escape;
+            break;
+
+        case EOF:
+            regexp_end(ctx, EOF); /* Unterminated set in Regular Expression literal.*/
+            break;
+
+        default:
+            ngx_putc(c, out);
+        }
+
+        return 1;
+
+    case sw_regexp_class_escape:
+        if (c == EOF) {
+            regexp_end(ctx, EOF); /* Unterminated set in Regular Expression literal.*/
+            return 1;
+        }
+
+        ngx_putc(c, out);
+        ctx->state = sw_regexp_class;
+        return 1;
+
+    default: /* sw_done */
+        return 1;
+    }
+}
+
+
+/*
+ * skip -- the bulk paths of step(): a run of plain bytes or whitespace
+ * between tokens, the body of a comment or of a literal is consumed at
+ * once with the same effect as feeding the bytes to step() one by one.
+ * Returns the first byte that is left to step().
+ */
+
+static u_char *skip(ngx_jsmin_t *ctx, u_char *p, u_char *last,
+    ngx_buf_t *out)
+{
+    int      a;
+    u_char  *q, *end;
+
+    /*
+     * the most bytes that can be copied to out: step() is called right
+     * after a copy and may write NGX_JSMIN_RESERVE bytes of its own
+     */
+
+    a = (int) (out->end - NGX_JSMIN_RESERVE - out->last);
+
+    if (a < 0) {
+        a = 0;
+    }
+
+    end = (last - p > a) ? p + a : last;
+
+    switch (ctx->state) {
+
+    case sw_next:
+        a = ctx->a;
+
+        if (a == EOF) {
+            return p;
+        }
+
+        if (a == ' ' || a == '\n') {
+
+            if (!(ngx_jsmin_class[*p] & NGX_JSMIN_SPACE)) {
+                return p;
+            }
+
+            /* whitespace after whitespace is dropped */
+
+            q = scan_space(p, last);
+
+            if (a == ' ' && scan_eol(p, q) < q) {
+                a = '\n';
             }
+
+        } else if (ngx_jsmin_class[*p] & NGX_JSMIN_PLAIN) {
+
+            if (ctx->x == ' ' || ctx->x == '\n' || p == end) {
+                return p;
+            }
+
+            /* output A and all but the last byte, which becomes A */
+
+            q = scan_plain(p, end);
+
+            ngx_putc(a, out);
+            out->last = ngx_cpymem(out->last, p, q - p - 1);
+
+            ctx->y = (q - p > 1) ? q[-2] : ctx->x;
+            ctx->x = q[-1];
+            ctx->a = q[-1];
+            ctx->b = q[-1];
+            ctx->regexp = 0;
+
+            return q;
+
+        } else if (ngx_jsmin_class[*p] & NGX_JSMIN_SPACE) {
+
+            /* whitespace after a token that needs nothing around it */
+
+            if (isAlphanum(a)) {
+                return p;
+            }
+
+            switch (a) {
+            case '}':
+            case ']':
+            case ')':
+            case '+':
+            case '-':
+            case '"':
+            case '\'':
+            case '`':
+                return p;
+            }
+
+            q = scan_space(p, last);
+
+        } else {
+            return p;
         }
+
+        ctx->y = (q - p > 1) ? get(q[-2]) : ctx->x;
+        ctx->x = get(q[-1]);
+        ctx->a = a;
+        ctx->b = ctx->x;
+        ctx->regexp = 0;
+
+        return q;
+
+    case sw_line_comment:
+        return scan_eol(p, last);
+
+    case sw_block_comment:
+        q = memchr(p, '*', last - p);
+        return q ? q : last;
+
+    /*
+     * the body of a string or regular expression literal is copied as is,
+     * up to end as a plain run, as a literal may be longer than out
+     */
+
+    case sw_string:
+        q = scan_literal(p, end, (u_char) ctx->b, '\\', '\\');
+        break;
+
+    case sw_regexp:
+        q = scan_literal(p, end, '/', '\\', '[');
+        break;
+
+    case sw_regexp_class:
+        q = scan_literal(p, end, ']', '\\', '\\');
+        break;
+
+    default:
+        return p;
     }
 
-    out->end = out->pos;
-    out->last = out->pos;
-    out->pos = out->start;
+    out->last = ngx_cpymem(out->last, p, q - p);
+
+    return q;
 }
 
 
+void
+ngx_jsmin_init(ngx_jsmin_t *ctx)
+{
+    ctx->state = sw_start;
+    ctx->regexp = 0;
+    ctx->bom = 0;
+    ctx->a = '\n';
+    ctx->b = EOF;
+    ctx->x = EOF;
+    ctx->y = EOF;
+}
+
+
+/* 
+ *  jsmin -- Copy the input to the output, deleting the characters which are
+ *  insignificant to JavaScript. Comments will be removed. Tabs will be
+ *  replaced with spaces. Carriage returns will be replaced with linefeeds.
+ *  Most spaces and linefeeds will be removed.
+ *
+ *  The input is consumed from in->pos up to in->last and the output is
+ *  appended at out->last. NGX_AGAIN is returned when less than
+ *  NGX_JSMIN_RESERVE bytes are left in out, the caller should provide
+ *  another output buffer and call jsmin() again with the rest of the
+ *  input. If last is set, the end of the input is processed as well.
+*/
+
+ngx_int_t
+jsmin(ngx_jsmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out, ngx_uint_t last)
+{
+    u_char  *p;
+
+    if (in) {
+        p = in->pos;
+
+        while (p < in->last) {
+
+            if (out->end - out->last < NGX_JSMIN_RESERVE) {
+                in->pos = p;
+                return NGX_AGAIN;
+            }
+
+            p = skip(ctx, p, in->last, out);
 
+            if (p < in->last) {
+                p += step(ctx, get(*p), out);
+            }
+        }
+
+        in->pos = p;
+    }
+
+    if (!last) {
+        return NGX_OK;
+    }
+
+    while (ctx->state != sw_done) {
+
+        if (out->end - out->last < NGX_JSMIN_RESERVE) {
+            return NGX_AGAIN;
+        }
+
+        (void) step(ctx, EOF, out);
+    }
+
+    return NGX_OK;
+}
@@ -1,3 +1,35 @@
-void jsmin(ngx_buf_t *in,ngx_buf_t *out);
+#ifndef _NGX_JSMIN_H_INCLUDED_
+#define _NGX_JSMIN_H_INCLUDED_
 
 
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/* the most bytes jsmin() can write for a single input byte */
+#define NGX_JSMIN_RESERVE  4
+
+
+/*
+ * All the state of a minification lives in the context, there is nothing
+ * shared between contexts: each request gets its own one, and a context
+ * may be driven by any thread as long as only one uses it at a time.
+ */
+
+typedef struct {
+    ngx_uint_t   state;
+    ngx_uint_t   regexp;
+    ngx_uint_t   bom;
+    int          a;
+    int          b;
+    int          x;
+    int          y;
+} ngx_jsmin_t;
+
+
+void ngx_jsmin_init(ngx_jsmin_t *ctx);
+ngx_int_t jsmin(ngx_jsmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out,
+    ngx_uint_t last);
+
+
+#endif /* _NGX_JSMIN_H_INCLUDED_ */
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) skysbird
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_jsonmin.h"
+
+#if (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/*
+ * jsonmin removes the whitespace between the tokens of a JSON document:
+ * space, tab, linefeed and carriage return outside strings. Everything
+ * else is copied as is, strings included, and a document that is not
+ * valid JSON is not rejected. The only state kept between calls is
+ * whether the input stopped in a string or just after a backslash in it.
+ */
+
+enum {
+    sw_value = 0,
+    sw_string,
+    sw_escape
+};
+
+
+/*
+ * The bytes kept outside strings: all but space, tab, linefeed and carriage
+ * return. A byte is stored and the output moved by its entry, so the
+ * whitespace between tokens, which comes in short runs, is dropped without
+ * a branch.
+ */
+
+static const u_char  ngx_jsonmin_keep[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+
+/*
+ * scan_string -- return the first byte before last that is a quote or a
+ * backslash. With SSE2 the bytes are tested 16 at a time.
+ */
+
+static u_char *scan_string(u_char *p, u_char *last)
+{
+#if (__SSE2__)
+    int      mask;
+    __m128i  v, m;
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+#endif
+
+    while (p < last && *p != '"' && *p != '\\') {
+        p++;
+    }
+
+    return p;
+}
+
+
+void
+ngx_jsonmin_init(ngx_jsonmin_t *ctx)
+{
+    ctx->state = sw_value;
+}
+
+
+/*
+ * The input is consumed from in->pos up to in->last and the output is
+ * appended at out->last. NGX_AGAIN is returned when out is full, the
+ * caller should provide another output buffer and call jsonmin() again
+ * with the rest of the input. Nothing is held back, so last changes
+ * nothing.
+ */
+
+ngx_int_t
+jsonmin(ngx_jsonmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out, ngx_uint_t last)
+{
+    u_char      *p, *q, *o, *end, c;
+    ngx_uint_t   state;
+
+    if (in == NULL) {
+        return NGX_OK;
+    }
+
+    p = in->pos;
+    state = ctx->state;
+
+    while (p < in->last) {
+
+        if (out->end - out->last < NGX_JSONMIN_RESERVE) {
+            in->pos = p;
+            ctx->state = state;
+            return NGX_AGAIN;
+        }
+
+        /* the output is never longer than the input */
+
+        end = p + ngx_min(in->last - p, out->end - out->last);
+        o = out->last;
+
+        while (p < end) {
+
+            if (state == sw_value) {
+                c = *p++;
+                *o = c;
+
+                if (c == '"') {
+                    o++;
+                    state = sw_string;
+                    continue;
+                }
+
+                o += ngx_jsonmin_keep[c];
+                continue;
+            }
+
+            if (state == sw_string) {
+                q = scan_string(p, end);
+                o = ngx_cpymem(o, p, q - p);
+                p = q;
+
+                if (p == end) {
+                    break;
+                }
+
+                c = *p++;
+                *o++ = c;
+                state = (c == '"') ? sw_value : sw_escape;
+                continue;
+            }
+
+            *o++ = *p++;
+            state = sw_string;
+        }
+
+        out->last = o;
+    }
+
+    in->pos = p;
+    ctx->state = state;
+
+    return NGX_OK;
+}
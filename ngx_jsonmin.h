@@ -0,0 +1,25 @@
+#ifndef _NGX_JSONMIN_H_INCLUDED_
+#define _NGX_JSONMIN_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/* the most bytes jsonmin() can write for a single input byte */
+#define NGX_JSONMIN_RESERVE  1
+
+
+/* the machine of one document, initialized by ngx_jsonmin_init() */
+
+typedef struct {
+    ngx_uint_t   state;
+} ngx_jsonmin_t;
+
+
+void ngx_jsonmin_init(ngx_jsonmin_t *ctx);
+ngx_int_t jsonmin(ngx_jsonmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out,
+    ngx_uint_t last);
+
+
+#endif /* _NGX_JSONMIN_H_INCLUDED_ */
@@ -0,0 +1,744 @@
+/*
+ * Copyright (C) skysbird
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_xmlmin.h"
+
+
+/*
+ * xmlmin is a push parser for XML and SVG documents like htmlmin():
+ *
+ *   whitespace-only text between elements is removed, other runs of
+ *   whitespace in text become a single space, or a linefeed if the run
+ *   has one; in the SVG text elements the whitespace-only text becomes a
+ *   single space, and under xml:space="preserve" the text is kept as is;
+ *   the whitespace inside tags is removed or collapsed;
+ *   comments are removed, CDATA sections, processing instructions and
+ *   declarations are kept as is;
+ *   the elements and attributes of the editors listed below, the
+ *   declarations of their namespaces and metadata elements are removed.
+ */
+
+enum {
+    sw_start = 0,
+    sw_text,
+    sw_lt,
+    sw_bang,
+    sw_bang_dash,
+    sw_comment,
+    sw_cdata,
+    sw_pi,
+    sw_decl,
+    sw_name,
+    sw_name_rest,
+    sw_end_tag,
+    sw_tag,
+    sw_attr_name,
+    sw_attr_rest,
+    sw_value_start,
+    sw_value,
+    sw_done
+};
+
+
+/* the namespace prefixes of the editor data */
+
+static ngx_str_t  ngx_xmlmin_editors[] = {
+    ngx_string("inkscape:"),
+    ngx_string("sodipodi:"),
+    ngx_string("sketch:"),
+    ngx_string("serif:"),
+    ngx_null_string
+};
+
+
+/* the SVG elements whose whitespace is rendered */
+
+static ngx_str_t  ngx_xmlmin_text[] = {
+    ngx_string("text"),
+    ngx_string("tspan"),
+    ngx_string("textPath"),
+    ngx_null_string
+};
+
+
+#define ngx_xmlmin_space(c)                                                  \
+    ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+
+static void ngx_xmlmin_write(ngx_xmlmin_t *ctx, ngx_buf_t *out, u_char *p,
+    size_t n);
+static void ngx_xmlmin_node(ngx_xmlmin_t *ctx, ngx_buf_t *out);
+static void ngx_xmlmin_element(ngx_xmlmin_t *ctx, ngx_buf_t *out);
+static void ngx_xmlmin_attribute(ngx_xmlmin_t *ctx, ngx_buf_t *out);
+static void ngx_xmlmin_open(ngx_xmlmin_t *ctx);
+static void ngx_xmlmin_close(ngx_xmlmin_t *ctx);
+static ngx_uint_t ngx_xmlmin_find(ngx_str_t *names, u_char *name, size_t len,
+    ngx_uint_t prefix);
+
+
+void
+ngx_xmlmin_init(ngx_xmlmin_t *ctx)
+{
+    ngx_memzero(ctx, sizeof(ngx_xmlmin_t));
+
+    ctx->state = sw_start;
+}
+
+
+/*
+ * The input is consumed from in->pos up to in->last and the output is
+ * appended at out->last. NGX_AGAIN is returned when less than
+ * NGX_XMLMIN_RESERVE bytes are left in out, the caller should provide
+ * another output buffer and call xmlmin() again with the rest of the
+ * input. If last is set, the end of the input is processed as well.
+ */
+
+ngx_int_t
+xmlmin(ngx_xmlmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out, ngx_uint_t last)
+{
+    u_char  *p, *q, *end, c;
+    size_t   n;
+
+    if (in) {
+        p = in->pos;
+        end = in->last;
+
+        while (p < end) {
+
+            if (out->end - out->last < NGX_XMLMIN_RESERVE) {
+                in->pos = p;
+                return NGX_AGAIN;
+            }
+
+            c = *p;
+
+            /* the bytes from p to p + n fit in out */
+
+            n = ngx_min(end - p, out->end - out->last);
+
+            switch (ctx->state) {
+
+            case sw_start:
+                if (ngx_xmlmin_space(c)) {
+                    p++;
+                    break;
+                }
+
+                ctx->state = sw_text;
+
+                /* fall through */
+
+            case sw_text:
+                if (c == '<') {
+                    ctx->hold[0] = c;
+                    ctx->hold_len = 1;
+                    ctx->state = sw_lt;
+                    p++;
+                    break;
+                }
+
+                if (ctx->preserve) {
+                    q = ngx_strlchr(p, p + n, '<');
+                    q = q ? q : p + n;
+
+                    ngx_xmlmin_write(ctx, out, p, q - p);
+                    p = q;
+                    break;
+                }
+
+                if (ngx_xmlmin_space(c)) {
+                    if (ctx->space != '\n') {
+                        ctx->space = (c == '\n' || c == '\r') ? '\n' : ' ';
+                    }
+
+                    p++;
+                    break;
+                }
+
+                if (ctx->space) {
+                    ngx_xmlmin_write(ctx, out, &ctx->space, 1);
+                    ctx->space = 0;
+                    n--;
+                }
+
+                ctx->content = 1;
+
+                for (q = p; q < p + n && *q != '<' && !ngx_xmlmin_space(*q);
+                     q++)
+                {
+                    /* void */
+                }
+
+                ngx_xmlmin_write(ctx, out, p, q - p);
+                p = q;
+                break;
+
+            case sw_lt:
+                if (c == '!') {
+                    ctx->hold[ctx->hold_len++] = c;
+                    ctx->state = sw_bang;
+                    p++;
+                    break;
+                }
+
+                if (c == '?') {
+                    ngx_xmlmin_node(ctx, out);
+                    ngx_xmlmin_write(ctx, out, p, 1);
+                    ctx->count = 0;
+                    ctx->state = sw_pi;
+                    p++;
+                    break;
+                }
+
+                if (c == '/') {
+                    ngx_xmlmin_node(ctx, out);
+                    ngx_xmlmin_write(ctx, out, p, 1);
+                    ctx->state = sw_end_tag;
+                    p++;
+                    break;
+                }
+
+                if (!ngx_xmlmin_space(c) && c != '<' && c != '>' && c != '=') {
+                    ctx->state = sw_name;
+                    break;
+                }
+
+                /* a "<" in text */
+
+                ctx->content = 1;
+                ngx_xmlmin_node(ctx, out);
+                ctx->content = 1;
+                ctx->state = sw_text;
+                break;
+
+            case sw_bang:
+                if (c == '-') {
+                    ctx->hold[ctx->hold_len++] = c;
+                    ctx->state = sw_bang_dash;
+                    p++;
+                    break;
+                }
+
+                ctx->count = 0;
+
+                if (c == '[') {
+                    ctx->content = 1;
+                    ngx_xmlmin_node(ctx, out);
+                    ctx->content = 1;
+                    ctx->state = sw_cdata;
+                    break;
+                }
+
+                ngx_xmlmin_node(ctx, out);
+                ctx->state = sw_decl;
+                break;
+
+            case sw_bang_dash:
+                if (c == '-') {
+                    ctx->hold_len = 0;
+                    ctx->count = 0;
+                    ctx->state = sw_comment;
+                    p++;
+                    break;
+                }
+
+                ngx_xmlmin_node(ctx, out);
+                ctx->count = 0;
+                ctx->state = sw_decl;
+                break;
+
+            case sw_comment:
+                if (c == '-') {
+                    ctx->count++;
+                    p++;
+                    break;
+                }
+
+                if (c == '>' && ctx->count >= 2) {
+                    ctx->state = sw_text;
+                    p++;
+                    break;
+                }
+
+                ctx->count = 0;
+
+                q = ngx_strlchr(p + 1, end, '-');
+                p = q ? q : end;
+                break;
+
+            case sw_cdata:
+                ngx_xmlmin_write(ctx, out, p, 1);
+                p++;
+
+                if (c == ']') {
+                    ctx->count++;
+
+                } else if (c == '>' && ctx->count >= 2) {
+                    ctx->state = sw_text;
+
+                } else {
+                    ctx->count = 0;
+                }
+
+                break;
+
+            case sw_pi:
+                ngx_xmlmin_write(ctx, out, p, 1);
+                p++;
+
+                if (c == '>' && ctx->count) {
+                    ctx->state = sw_text;
+                }
+
+                ctx->count = (c == '?');
+                break;
+
+            case sw_decl:
+                ngx_xmlmin_write(ctx, out, p, 1);
+                p++;
+
+                /* the brackets of an internal DTD subset */
+
+                if (c == '[') {
+                    ctx->count++;
+
+                } else if (c == ']' && ctx->count) {
+                    ctx->count--;
+
+                } else if (c == '>' && ctx->count == 0) {
+                    ctx->state = sw_text;
+                }
+
+                break;
+
+            case sw_name:
+                if (ngx_xmlmin_space(c) || c == '/' || c == '>') {
+                    ngx_xmlmin_element(ctx, out);
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if (ctx->hold_len == sizeof(ctx->hold)) {
+                    ngx_xmlmin_element(ctx, out);
+                    ctx->state = sw_name_rest;
+                    break;
+                }
+
+                ctx->hold[ctx->hold_len++] = c;
+                p++;
+                break;
+
+            case sw_name_rest:
+            case sw_attr_rest:
+                if (ngx_xmlmin_space(c) || c == '/' || c == '>' || c == '=') {
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if (!ctx->attr) {
+                    ngx_xmlmin_write(ctx, out, p, 1);
+                }
+
+                p++;
+                break;
+
+            case sw_end_tag:
+                if (!ngx_xmlmin_space(c)) {
+                    ngx_xmlmin_write(ctx, out, p, 1);
+                }
+
+                if (c == '>') {
+                    ngx_xmlmin_close(ctx);
+                }
+
+                p++;
+                break;
+
+            case sw_tag:
+                if (ngx_xmlmin_space(c)) {
+                    ctx->tag_space = 1;
+                    p++;
+                    break;
+                }
+
+                if (c == '>') {
+                    ngx_xmlmin_write(ctx, out, p, 1);
+                    ngx_xmlmin_open(ctx);
+                    p++;
+                    break;
+                }
+
+                if (c == '/') {
+                    ngx_xmlmin_write(ctx, out, p, 1);
+                    ctx->self_closing = 1;
+                    ctx->tag_space = 0;
+                    p++;
+                    break;
+                }
+
+                if (c == '=') {
+                    if (!ctx->attr) {
+                        ngx_xmlmin_write(ctx, out, p, 1);
+                    }
+
+                    ctx->tag_space = 0;
+                    ctx->state = sw_value_start;
+                    p++;
+                    break;
+                }
+
+                if (c == '"' || c == '\'') {
+                    ctx->state = sw_value_start;
+                    break;
+                }
+
+                /* an attribute name, held with the space before it */
+
+                ctx->hold_len = 0;
+
+                if (ctx->tag_space) {
+                    ctx->hold[ctx->hold_len++] = ' ';
+                    ctx->tag_space = 0;
+                }
+
+                ctx->attr = 0;
+                ctx->self_closing = 0;
+                ctx->state = sw_attr_name;
+                break;
+
+            case sw_attr_name:
+                if (ngx_xmlmin_space(c) || c == '/' || c == '>' || c == '=') {
+                    ngx_xmlmin_attribute(ctx, out);
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if (ctx->hold_len == sizeof(ctx->hold)) {
+                    ngx_xmlmin_attribute(ctx, out);
+                    ctx->state = sw_attr_rest;
+                    break;
+                }
+
+                ctx->hold[ctx->hold_len++] = c;
+                p++;
+                break;
+
+            case sw_value_start:
+                if (ngx_xmlmin_space(c)) {
+                    p++;
+                    break;
+                }
+
+                if (c == '>') {
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                ctx->value_len = 0;
+                ctx->quote = 0;
+
+                if (c == '"' || c == '\'') {
+                    ctx->quote = c;
+
+                    if (!ctx->attr) {
+                        ngx_xmlmin_write(ctx, out, p, 1);
+                    }
+
+                    p++;
+                }
+
+                ctx->state = sw_value;
+                break;
+
+            case sw_value:
+                if (ctx->quote ? c == ctx->quote
+                               : ngx_xmlmin_space(c) || c == '>')
+                {
+                    if (ctx->quote) {
+                        if (!ctx->attr) {
+                            ngx_xmlmin_write(ctx, out, p, 1);
+                        }
+
+                        p++;
+                    }
+
+                    if (ctx->xml_space) {
+                        ctx->preserve_tag = (ctx->value_len == 8
+                                             && ngx_strncmp(ctx->value,
+                                                            "preserve", 8)
+                                                == 0);
+                        ctx->xml_space = 0;
+                    }
+
+                    ctx->state = sw_tag;
+                    break;
+                }
+
+                if (ctx->quote) {
+                    q = ngx_strlchr(p, p + n, ctx->quote);
+                    q = q ? q : p + n;
+
+                } else {
+                    for (q = p;
+                         q < p + n && !ngx_xmlmin_space(*q) && *q != '>';
+                         q++)
+                    {
+                        /* void */
+                    }
+                }
+
+                if (ctx->xml_space) {
+                    if (ctx->value_len + (q - p) <= sizeof(ctx->value)) {
+                        ngx_memcpy(ctx->value + ctx->value_len, p, q - p);
+                    }
+
+                    ctx->value_len += q - p;
+                }
+
+                if (!ctx->attr) {
+                    ngx_xmlmin_write(ctx, out, p, q - p);
+                }
+
+                p = q;
+                break;
+
+            default: /* sw_done */
+                p = end;
+                break;
+            }
+        }
+
+        in->pos = p;
+    }
+
+    if (!last) {
+        return NGX_OK;
+    }
+
+    if (ctx->state == sw_done) {
+        return NGX_OK;
+    }
+
+    if (out->end - out->last < NGX_XMLMIN_RESERVE) {
+        return NGX_AGAIN;
+    }
+
+    /* the trailing whitespace is dropped, a cut tag is written as is */
+
+    switch (ctx->state) {
+
+    case sw_lt:
+    case sw_bang:
+    case sw_bang_dash:
+    case sw_name:
+        ctx->content = 1;
+        ngx_xmlmin_node(ctx, out);
+        break;
+
+    case sw_attr_name:
+        ngx_xmlmin_attribute(ctx, out);
+        break;
+    }
+
+    ctx->state = sw_done;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_xmlmin_write(ngx_xmlmin_t *ctx, ngx_buf_t *out, u_char *p, size_t n)
+{
+    if (!ctx->drop) {
+        out->last = ngx_cpymem(out->last, p, n);
+    }
+}
+
+
+/*
+ * Ends the text before a tag, a comment is not a node: the whitespace
+ * around it is collapsed to a single space. The held bytes are written.
+ */
+
+static void
+ngx_xmlmin_node(ngx_xmlmin_t *ctx, ngx_buf_t *out)
+{
+    if (ctx->space) {
+        if (ctx->content || ctx->text) {
+            ngx_xmlmin_write(ctx, out, &ctx->space, 1);
+        }
+
+        ctx->space = 0;
+    }
+
+    ctx->content = 0;
+
+    ngx_xmlmin_write(ctx, out, ctx->hold, ctx->hold_len);
+    ctx->hold_len = 0;
+}
+
+
+/* the name of a start tag is held in ctx->hold after the "<" */
+
+static void
+ngx_xmlmin_element(ngx_xmlmin_t *ctx, ngx_buf_t *out)
+{
+    u_char  *name;
+    size_t   len;
+
+    name = ctx->hold + 1;
+    len = ctx->hold_len - 1;
+
+    ctx->attr = 0;
+    ctx->tag_space = 0;
+    ctx->self_closing = 0;
+    ctx->preserve_tag = 0;
+    ctx->xml_space = 0;
+
+    ctx->text_tag = ngx_xmlmin_find(ngx_xmlmin_text, name, len, 0);
+
+    if (!ctx->drop
+        && ((len == 8 && ngx_strncmp(name, "metadata", 8) == 0)
+            || ngx_xmlmin_find(ngx_xmlmin_editors, name, len, 1)))
+    {
+        /* the text around the element is joined as if it were a comment */
+
+        ctx->saved_space = ctx->space;
+        ctx->saved_content = ctx->content;
+        ctx->space = 0;
+
+        ctx->drop = 1;
+    }
+
+    ngx_xmlmin_node(ctx, out);
+}
+
+
+/* the name of an attribute is held in ctx->hold */
+
+static void
+ngx_xmlmin_attribute(ngx_xmlmin_t *ctx, ngx_buf_t *out)
+{
+    u_char  *name;
+    size_t   len;
+
+    name = ctx->hold;
+    len = ctx->hold_len;
+
+    if (len && name[0] == ' ') {
+        name++;
+        len--;
+    }
+
+    if (len == 9 && ngx_strncmp(name, "xml:space", 9) == 0) {
+        ctx->xml_space = 1;
+    }
+
+    if (ngx_xmlmin_find(ngx_xmlmin_editors, name, len, 1)
+        || (len > 6
+            && ngx_strncmp(name, "xmlns:", 6) == 0
+            && ngx_xmlmin_find(ngx_xmlmin_editors, name + 6, len - 6, 2)))
+    {
+        ctx->attr = 1;
+
+    } else {
+        ngx_xmlmin_write(ctx, out, ctx->hold, ctx->hold_len);
+    }
+
+    ctx->hold_len = 0;
+}
+
+
+/* the ">" of a start tag or of an empty element tag */
+
+static void
+ngx_xmlmin_open(ngx_xmlmin_t *ctx)
+{
+    ctx->state = sw_text;
+    ctx->content = 0;
+    ctx->attr = 0;
+    ctx->tag_space = 0;
+
+    if (ctx->self_closing) {
+
+        if (ctx->drop && ctx->skip == 0) {
+            ctx->drop = 0;
+            ctx->space = ctx->saved_space;
+            ctx->content = ctx->saved_content;
+        }
+
+        return;
+    }
+
+    ctx->depth++;
+
+    if (ctx->drop && ctx->skip == 0) {
+        ctx->skip = ctx->depth;
+    }
+
+    if (ctx->text_tag && ctx->text == 0) {
+        ctx->text = ctx->depth;
+    }
+
+    if (ctx->preserve_tag && ctx->preserve == 0) {
+        ctx->preserve = ctx->depth;
+    }
+}
+
+
+/* the ">" of an end tag */
+
+static void
+ngx_xmlmin_close(ngx_xmlmin_t *ctx)
+{
+    ctx->state = sw_text;
+    ctx->content = 0;
+
+    if (ctx->text == ctx->depth) {
+        ctx->text = 0;
+    }
+
+    if (ctx->preserve == ctx->depth) {
+        ctx->preserve = 0;
+    }
+
+    if (ctx->skip == ctx->depth) {
+        ctx->skip = 0;
+        ctx->drop = 0;
+        ctx->space = ctx->saved_space;
+        ctx->content = ctx->saved_content;
+    }
+
+    if (ctx->depth) {
+        ctx->depth--;
+    }
+}
+
+
+/*
+ * Tests if the name is in the list: match is 0 for the whole name, 1 for
+ * a prefix and 2 for the whole name without the colon of a prefix.
+ */
+
+static ngx_uint_t
+ngx_xmlmin_find(ngx_str_t *names, u_char *name, size_t len, ngx_uint_t match)
+{
+    size_t  n;
+
+    for ( /* void */ ; names->len; names++) {
+
+        n = (match == 2) ? names->len - 1 : names->len;
+
+        if ((match == 1 ? len >= n : len == n)
+            && ngx_strncmp(name, names->data, n) == 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef _NGX_XMLMIN_H_INCLUDED_
+#define _NGX_XMLMIN_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/* the most bytes xmlmin() can write for a single input byte */
+#define NGX_XMLMIN_RESERVE  40
+
+
+/* the machine of one document, initialized by ngx_xmlmin_init() */
+
+typedef struct {
+    ngx_uint_t   state;
+    ngx_uint_t   count;
+    ngx_uint_t   quote;
+
+    /* the pending whitespace and if the text node has other bytes */
+    u_char       space;
+    ngx_uint_t   content;
+    u_char       saved_space;
+    ngx_uint_t   saved_content;
+
+    /* the depth of the open elements and of those changing the output */
+    ngx_uint_t   depth;
+    ngx_uint_t   text;
+    ngx_uint_t   preserve;
+    ngx_uint_t   skip;
+
+    unsigned     drop:1;
+    unsigned     attr:1;
+    unsigned     tag_space:1;
+    unsigned     self_closing:1;
+    unsigned     text_tag:1;
+    unsigned     preserve_tag:1;
+    unsigned     xml_space:1;
+
+    /* a tag or an attribute name that is not written yet */
+    u_char       hold[32];
+    size_t       hold_len;
+
+    u_char       value[8];
+    size_t       value_len;
+} ngx_xmlmin_t;
+
+
+void ngx_xmlmin_init(ngx_xmlmin_t *ctx);
+ngx_int_t xmlmin(ngx_xmlmin_t *ctx, ngx_buf_t *in, ngx_buf_t *out,
+    ngx_uint_t last);
+
+
+#endif /* _NGX_XMLMIN_H_INCLUDED_ */
@@ -0,0 +1,286 @@
+#!/bin/sh
+
+# A load test of nginx with the minify filter, driven by wrk.
+#
+# Every combination of minify on/off, sendfile on/off, a small and a large
+# file and keepalive on/off is run against a fresh nginx. Requests/s, the
+# p50 and p99 latency and the CPU time of a worker per second are printed,
+# and with -o written as CSV too.
+#
+#     NGINX=/usr/local/nginx/sbin/nginx ./load.sh -d 10 -c 50
+#
+# NGINX and WRK are the binaries, PORT the port to listen on, WORKERS the
+# number of worker processes and MINIFY_CONF more directives for the
+# location, e.g. MINIFY_CONF="minify_cache zone=minify:10m;".
+
+NGINX=${NGINX:-nginx}
+WRK=${WRK:-wrk}
+PORT=${PORT:-1985}
+WORKERS=${WORKERS:-1}
+MINIFY_CONF=${MINIFY_CONF:-}
+
+duration=10
+warmup=2
+connections=32
+threads=2
+small=2k
+large=1m
+csv=
+
+usage() {
+    cat >&2 <<END
+usage: load.sh [-d seconds] [-w seconds] [-c connections] [-t threads]
+               [-s size] [-l size] [-o file.csv]
+  -d  the time of each run, default $duration
+  -w  the time of the warm up run before each run, default $warmup
+  -c  the connections wrk keeps open, default $connections
+  -t  the threads of wrk, default $threads
+  -s  the size of the small file, default $small
+  -l  the size of the large file, default $large
+  -o  the CSV file for the results
+END
+    exit 1
+}
+
+while getopts d:w:c:t:s:l:o: opt; do
+    case $opt in
+    d) duration=$OPTARG ;;
+    w) warmup=$OPTARG ;;
+    c) connections=$OPTARG ;;
+    t) threads=$OPTARG ;;
+    s) small=$OPTARG ;;
+    l) large=$OPTARG ;;
+    o) csv=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+
+for bin in "$NGINX" "$WRK"; do
+    if ! command -v "$bin" >/dev/null 2>&1; then
+        echo "load.sh: \"$bin\" is not found" >&2
+        exit 1
+    fi
+done
+
+bytes() {
+    case $1 in
+    *[kK]) echo $(( ${1%?} * 1024 )) ;;
+    *[mM]) echo $(( ${1%?} * 1024 * 1024 )) ;;
+    *)     echo "$1" ;;
+    esac
+}
+
+prefix=$(mktemp -d "${TMPDIR:-/tmp}/minify_load.XXXXXX") || exit 1
+mkdir -p "$prefix/conf" "$prefix/logs" "$prefix/html"
+
+master=
+
+cleanup() {
+    if [ -n "$master" ]; then
+        kill -QUIT "$master" 2>/dev/null
+    fi
+
+    rm -rf "$prefix"
+}
+
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+
+# the test files are a sample script repeated up to the size
+
+cat > "$prefix/sample.js" <<'END'
+/*
+ * A sample of the usual script: comments, strings, regular expressions
+ * and indentation.
+ */
+
+(function (window, undefined) {
+    'use strict';
+
+    var rtrim = /^[\s\uFEFF\xA0]+|[\s\uFEFF\xA0]+$/g,
+        version = "1.0.0";
+
+    // trims a string
+    function trim(text) {
+        return text == null ? "" : (text + "").replace(rtrim, "");
+    }
+
+    function each(list, callback) {
+        var i, length = list.length;
+
+        for (i = 0; i < length; i++) {
+            if (callback.call(list[i], i, list[i]) === false) {
+                break;
+            }
+        }
+
+        return list;
+    }
+
+    window.lib = { trim: trim, each: each, version: version };
+
+})(window);
+END
+
+make_file() {
+    size=$(bytes "$2")
+
+    cp "$prefix/sample.js" "$1"
+
+    while [ "$(wc -c < "$1")" -lt "$size" ]; do
+        cat "$1" "$1" > "$1.tmp"
+        mv "$1.tmp" "$1"
+    done
+
+    head -c "$size" "$1" > "$1.tmp"
+    mv "$1.tmp" "$1"
+}
+
+make_file "$prefix/html/small.js" "$small"
+make_file "$prefix/html/large.js" "$large"
+
+
+start_nginx() {
+    cat > "$prefix/conf/nginx.conf" <<END
+worker_processes  $WORKERS;
+pid               logs/nginx.pid;
+error_log         logs/error.log warn;
+
+events {
+    worker_connections  4096;
+}
+
+http {
+    types {
+        application/javascript  js;
+    }
+
+    access_log          off;
+    sendfile            $2;
+    keepalive_requests  1000000;
+
+    server {
+        listen  127.0.0.1:$PORT;
+        root    $prefix/html;
+
+        location / {
+            minify  $1;
+            $MINIFY_CONF
+        }
+    }
+}
+END
+
+    if ! "$NGINX" -p "$prefix/" -c conf/nginx.conf; then
+        echo "load.sh: nginx did not start, see $prefix/logs/error.log" >&2
+        trap - EXIT
+        exit 1
+    fi
+
+    i=0
+
+    while [ ! -s "$prefix/logs/nginx.pid" ] && [ $i -lt 50 ]; do
+        sleep 0.1
+        i=$(( i + 1 ))
+    done
+
+    master=$(cat "$prefix/logs/nginx.pid")
+}
+
+
+stop_nginx() {
+    kill -QUIT "$master"
+
+    while kill -0 "$master" 2>/dev/null; do
+        sleep 0.1
+    done
+
+    master=
+}
+
+
+# the user and system CPU time of all workers, in clock ticks
+
+cpu_ticks() {
+    for pid in $(ps -o pid= --ppid "$master"); do
+        cat "/proc/$pid/stat" 2>/dev/null
+    done | awk '{ t += $14 + $15 } END { print t + 0 }'
+}
+
+
+# prints "requests/s p50 p99" from the output of wrk --latency, in ms
+
+parse_wrk() {
+    awk '
+        function ms(v) {
+            if (v ~ /us$/) { return v / 1000 }
+            if (v ~ /ms$/) { return v + 0 }
+            if (v ~ /m$/) { return v * 60000 }
+            return v * 1000
+        }
+        $1 == "Requests/sec:" { rps = $2 }
+        $1 == "50%" { p50 = ms($2) }
+        $1 == "99%" { p99 = ms($2) }
+        END { printf "%.1f %.3f %.3f\n", rps, p50, p99 }
+    '
+}
+
+
+hz=$(getconf CLK_TCK)
+
+printf "%-7s %-9s %-6s %-10s %12s %10s %10s %8s\n" \
+       minify sendfile file keepalive "requests/s" "p50 ms" "p99 ms" "cpu %"
+
+if [ -n "$csv" ]; then
+    echo "minify,sendfile,file,keepalive,rps,p50_ms,p99_ms,cpu_percent" \
+         > "$csv"
+fi
+
+for minify in off on; do
+    for sendfile in off on; do
+
+        start_nginx $minify $sendfile
+
+        for file in small large; do
+            for keepalive in on off; do
+
+                if [ $keepalive = on ]; then
+                    set --
+                else
+                    set -- -H "Connection: close"
+                fi
+
+                url="http://127.0.0.1:$PORT/$file.js"
+
+                "$WRK" -t "$threads" -c "$connections" -d "${warmup}s" \
+                       "$@" "$url" > /dev/null
+
+                before=$(cpu_ticks)
+
+                result=$("$WRK" -t "$threads" -c "$connections" \
+                                -d "${duration}s" --latency "$@" "$url" \
+                         | parse_wrk)
+
+                after=$(cpu_ticks)
+
+                cpu=$(awk -v t=$(( after - before )) -v hz="$hz" \
+                          -v d="$duration" -v w="$WORKERS" \
+                          'BEGIN { printf "%.1f", 100 * t / hz / d / w }')
+
+                set -- $result
+
+                printf "%-7s %-9s %-6s %-10s %12s %10s %10s %8s\n" \
+                       $minify $sendfile $file $keepalive "$1" "$2" "$3" \
+                       "$cpu"
+
+                if [ -n "$csv" ]; then
+                    echo "$minify,$sendfile,$file,$keepalive,$1,$2,$3,$cpu" \
+                         >> "$csv"
+                fi
+            done
+        done
+
+        stop_nginx
+    done
+done
@@ -0,0 +1,603 @@
+
+/*
+ * Copyright (C) skysbird
+ */
+
+
+/*
+ * A benchmark of jsmin() and cssmin() outside nginx. Every file is minified
+ * the way the filter does it: the input is given in chunks of the size the
+ * filter reads files with, and the output goes to a buffer of the size of
+ * one minify_buffers buffer, which is emptied every time the engine asks
+ * for more room.
+ *
+ * Each file is run as is and tiled or cut to the sizes given with -s, for
+ * at least the time given with -t, and the throughput, the time per input
+ * byte, the heap allocations per run and the size of the output are
+ * printed. Without files a small built-in sample of each language is used.
+ *
+ *     minify_bench [-t seconds] [-s size,...] [-b size] [-e engine] file ...
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <time.h>
+#include <errno.h>
+#include "ngx_jsmin.h"
+#include "ngx_cssmin.h"
+
+
+#define BENCH_READ_SIZE   32768
+#define BENCH_BUF_SIZE    4096
+#define BENCH_MIN_TIME    0.5
+#define BENCH_SIZES       "0,4k,256k,4m"
+
+#define BENCH_JS          0
+#define BENCH_CSS         1
+
+
+typedef struct {
+    char                *name;
+    char                *ext;
+    ngx_uint_t           type;
+    ngx_uint_t           css_engine;
+} bench_engine_t;
+
+
+typedef struct {
+    char                *name;
+    u_char              *data;
+    size_t               len;
+} bench_file_t;
+
+
+typedef struct {
+    ngx_uint_t           runs;
+    size_t               out;
+    double               time;
+    size_t               allocs;
+} bench_result_t;
+
+
+static bench_engine_t  bench_engines[] = {
+    { "js", ".js", BENCH_JS, 0 },
+    { "css", ".css", BENCH_CSS, NGX_CSSMIN_SCAN },
+    { "css-machine", ".css", BENCH_CSS, NGX_CSSMIN_MACHINE },
+    { NULL, NULL, 0, 0 }
+};
+
+
+static char  bench_sample_js[] =
+    "/*\n"
+    " * A sample of the usual script: comments, strings, regular\n"
+    " * expressions and indentation.\n"
+    " */\n"
+    "\n"
+    "(function (window, undefined) {\n"
+    "    'use strict';\n"
+    "\n"
+    "    var rtrim = /^[\\s\\uFEFF\\xA0]+|[\\s\\uFEFF\\xA0]+$/g,\n"
+    "        version = \"1.0.0\";\n"
+    "\n"
+    "    // trims a string\n"
+    "    function trim(text) {\n"
+    "        return text == null ? \"\" : (text + \"\").replace(rtrim, \"\");\n"
+    "    }\n"
+    "\n"
+    "    function each(list, callback) {\n"
+    "        var i, length = list.length;\n"
+    "\n"
+    "        for (i = 0; i < length; i++) {\n"
+    "            if (callback.call(list[i], i, list[i]) === false) {\n"
+    "                break;\n"
+    "            }\n"
+    "        }\n"
+    "\n"
+    "        return list;\n"
+    "    }\n"
+    "\n"
+    "    window.lib = { trim: trim, each: each, version: version };\n"
+    "\n"
+    "})(window);\n";
+
+
+static char  bench_sample_css[] =
+    "/* a sample of the usual stylesheet */\n"
+    "\n"
+    "html, body {\n"
+    "    margin: 0;\n"
+    "    padding: 0;\n"
+    "    font: 14px/1.5 \"Helvetica Neue\", Arial, sans-serif;\n"
+    "}\n"
+    "\n"
+    ".nav > li a:hover,\n"
+    ".nav > li a:focus {\n"
+    "    color: #333333;\n"
+    "    background: url( \"images/nav.png\" ) no-repeat 0 0;\n"
+    "}\n"
+    "\n"
+    "@media (max-width: 767px) {\n"
+    "    .nav {\n"
+    "        display: none;   /* shown by the menu button */\n"
+    "    }\n"
+    "}\n";
+
+
+static ngx_uint_t  bench_counting;
+static size_t      bench_allocs;
+
+
+static void bench_usage(void);
+static ngx_int_t bench_parse_sizes(char *list, size_t *sizes, ngx_uint_t n);
+static ngx_int_t bench_read_file(char *name, bench_file_t *file);
+static u_char *bench_tile(bench_file_t *file, size_t len);
+static void bench_file(bench_file_t *file, bench_engine_t *only,
+    size_t *sizes, ngx_uint_t nsizes, size_t size, double min_time);
+static void bench_case(bench_file_t *file, bench_engine_t *engine,
+    u_char *data, size_t len, u_char *out, size_t size, double min_time);
+static size_t bench_run(bench_engine_t *engine, u_char *data, size_t len,
+    u_char *out, size_t size);
+static double bench_now(void);
+
+
+int
+main(int argc, char *argv[])
+{
+    char            *p, *sizes_list;
+    double           min_time;
+    size_t           size, sizes[16];
+    ngx_int_t        nsizes;
+    ngx_uint_t       i;
+    bench_file_t     file;
+    bench_engine_t  *engine, *only;
+
+    min_time = BENCH_MIN_TIME;
+    sizes_list = BENCH_SIZES;
+    size = BENCH_BUF_SIZE;
+    only = NULL;
+
+    for (i = 1; i < (ngx_uint_t) argc; i++) {
+
+        p = argv[i];
+
+        if (p[0] != '-' || p[1] == '\0') {
+            break;
+        }
+
+        if (p[2] != '\0' || i + 1 == (ngx_uint_t) argc) {
+            bench_usage();
+            return 1;
+        }
+
+        switch (p[1]) {
+
+        case 't':
+            min_time = strtod(argv[++i], NULL);
+            break;
+
+        case 's':
+            sizes_list = argv[++i];
+            break;
+
+        case 'b':
+            if (bench_parse_sizes(argv[++i], &size, 1) != 1
+                || size < 2 * NGX_JSMIN_RESERVE)
+            {
+                bench_usage();
+                return 1;
+            }
+
+            break;
+
+        case 'e':
+            i++;
+
+            for (engine = bench_engines; engine->name; engine++) {
+                if (strcmp(engine->name, argv[i]) == 0) {
+                    only = engine;
+                    break;
+                }
+            }
+
+            if (only == NULL) {
+                fprintf(stderr, "unknown engine \"%s\"\n", argv[i]);
+                return 1;
+            }
+
+            break;
+
+        default:
+            bench_usage();
+            return 1;
+        }
+    }
+
+    nsizes = bench_parse_sizes(sizes_list, sizes, 16);
+
+    if (nsizes <= 0 || min_time <= 0) {
+        bench_usage();
+        return 1;
+    }
+
+    printf("%-24s %-12s %10s %10s %7s %9s %8s %7s\n",
+           "file", "engine", "in", "out", "ratio", "MB/s", "ns/byte",
+           "allocs");
+
+    if (i == (ngx_uint_t) argc) {
+
+        file.name = "sample.js";
+        file.data = (u_char *) bench_sample_js;
+        file.len = sizeof(bench_sample_js) - 1;
+
+        bench_file(&file, only, sizes, nsizes, size, min_time);
+
+        file.name = "sample.css";
+        file.data = (u_char *) bench_sample_css;
+        file.len = sizeof(bench_sample_css) - 1;
+
+        bench_file(&file, only, sizes, nsizes, size, min_time);
+
+        return 0;
+    }
+
+    for ( /* void */ ; i < (ngx_uint_t) argc; i++) {
+
+        if (bench_read_file(argv[i], &file) != NGX_OK) {
+            return 1;
+        }
+
+        bench_file(&file, only, sizes, nsizes, size, min_time);
+
+        free(file.data);
+    }
+
+    return 0;
+}
+
+
+static void
+bench_usage(void)
+{
+    fprintf(stderr,
+            "usage: minify_bench [-t seconds] [-s size,...] [-b size] "
+            "[-e engine] [file ...]\n"
+            "  -t  the least time to run each case, default %.1f\n"
+            "  -s  the input sizes, 0 is the file as is, default %s\n"
+            "  -b  the size of the output buffer, default %d\n"
+            "  -e  js, css or css-machine, by default the file extension\n"
+            "      selects the engines\n",
+            BENCH_MIN_TIME, BENCH_SIZES, BENCH_BUF_SIZE);
+}
+
+
+/* "0,4k,256k,4m" */
+
+static ngx_int_t
+bench_parse_sizes(char *list, size_t *sizes, ngx_uint_t n)
+{
+    char        *p;
+    size_t       size;
+    ngx_uint_t   i;
+
+    p = list;
+
+    for (i = 0; i < n; i++) {
+
+        if (*p < '0' || *p > '9') {
+            return NGX_ERROR;
+        }
+
+        size = strtoul(p, &p, 10);
+
+        switch (*p) {
+
+        case 'k':
+        case 'K':
+            size *= 1024;
+            p++;
+            break;
+
+        case 'm':
+        case 'M':
+            size *= 1024 * 1024;
+            p++;
+            break;
+        }
+
+        sizes[i] = size;
+
+        if (*p == '\0') {
+            return i + 1;
+        }
+
+        if (*p++ != ',') {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+bench_read_file(char *name, bench_file_t *file)
+{
+    long   len;
+    FILE  *f;
+
+    f = fopen(name, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "fopen(\"%s\") failed: %s\n", name, strerror(errno));
+        return NGX_ERROR;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0) {
+        fprintf(stderr, "\"%s\" is not a regular file\n", name);
+        fclose(f);
+        return NGX_ERROR;
+    }
+
+    rewind(f);
+
+    file->name = name;
+    file->len = len;
+    file->data = malloc(len ? len : 1);
+
+    if (file->data == NULL
+        || fread(file->data, 1, len, f) != (size_t) len)
+    {
+        fprintf(stderr, "could not read \"%s\"\n", name);
+        fclose(f);
+        return NGX_ERROR;
+    }
+
+    fclose(f);
+
+    return NGX_OK;
+}
+
+
+/* the file is repeated, or cut, to the given length */
+
+static u_char *
+bench_tile(bench_file_t *file, size_t len)
+{
+    u_char  *data, *p, *last;
+    size_t   n;
+
+    data = malloc(len ? len : 1);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    p = data;
+    last = data + len;
+
+    while (p < last) {
+        n = ngx_min(file->len, (size_t) (last - p));
+        p = ngx_cpymem(p, file->data, n);
+    }
+
+    return data;
+}
+
+
+static void
+bench_file(bench_file_t *file, bench_engine_t *only, size_t *sizes,
+    ngx_uint_t nsizes, size_t size, double min_time)
+{
+    u_char          *data, *out;
+    size_t           len, ext;
+    ngx_uint_t       i;
+    bench_engine_t  *engine;
+
+    if (file->len == 0) {
+        fprintf(stderr, "\"%s\" is empty, skipped\n", file->name);
+        return;
+    }
+
+    out = malloc(size);
+    if (out == NULL) {
+        return;
+    }
+
+    for (engine = bench_engines; engine->name; engine++) {
+
+        if (only) {
+            if (engine != only) {
+                continue;
+            }
+
+        } else {
+            len = strlen(file->name);
+            ext = strlen(engine->ext);
+
+            if (len < ext || strcmp(file->name + len - ext, engine->ext) != 0)
+            {
+                continue;
+            }
+        }
+
+        for (i = 0; i < nsizes; i++) {
+
+            if (sizes[i] == 0) {
+                bench_case(file, engine, file->data, file->len, out, size,
+                           min_time);
+                continue;
+            }
+
+            data = bench_tile(file, sizes[i]);
+            if (data == NULL) {
+                fprintf(stderr, "could not allocate %zu bytes\n", sizes[i]);
+                break;
+            }
+
+            bench_case(file, engine, data, sizes[i], out, size, min_time);
+
+            free(data);
+        }
+    }
+
+    free(out);
+}
+
+
+static void
+bench_case(bench_file_t *file, bench_engine_t *engine, u_char *data,
+    size_t len, u_char *out, size_t size, double min_time)
+{
+    char            *name;
+    double           start, now, mbs, nsb;
+    bench_result_t   res;
+
+    /* a run to warm up the caches, it also gives the output size */
+
+    res.out = bench_run(engine, data, len, out, size);
+    res.runs = 0;
+
+    bench_allocs = 0;
+    bench_counting = 1;
+
+    start = bench_now();
+
+    do {
+        bench_run(engine, data, len, out, size);
+        res.runs++;
+        now = bench_now();
+    } while (now - start < min_time);
+
+    bench_counting = 0;
+
+    res.time = now - start;
+    res.allocs = bench_allocs;
+
+    mbs = (double) len * res.runs / res.time / (1024 * 1024);
+    nsb = res.time * 1e9 / ((double) len * res.runs);
+
+    name = strrchr(file->name, '/');
+    name = name ? name + 1 : file->name;
+
+#if (NGX_BENCH_ALLOCS)
+    printf("%-24.24s %-12s %10zu %10zu %6.1f%% %9.1f %8.3f %7.1f\n",
+           name, engine->name, len, res.out, 100.0 * res.out / len,
+           mbs, nsb, (double) res.allocs / res.runs);
+#else
+    printf("%-24.24s %-12s %10zu %10zu %6.1f%% %9.1f %8.3f %7s\n",
+           name, engine->name, len, res.out, 100.0 * res.out / len,
+           mbs, nsb, "-");
+#endif
+}
+
+
+/*
+ * Returns the size of the output, which is dropped every time the engine
+ * has no more room in the buffer, as if it had been sent.
+ */
+
+static size_t
+bench_run(bench_engine_t *engine, u_char *data, size_t len, u_char *out,
+    size_t size)
+{
+    size_t        total;
+    ngx_int_t     rc;
+    ngx_buf_t     in, b;
+    ngx_uint_t    last;
+    ngx_jsmin_t   js;
+    ngx_cssmin_t  css;
+
+    if (engine->type == BENCH_JS) {
+        ngx_jsmin_init(&js);
+
+    } else {
+        ngx_cssmin_init(&css);
+        css.engine = engine->css_engine;
+    }
+
+    b.start = out;
+    b.pos = out;
+    b.last = out;
+    b.end = out + size;
+
+    in.start = data;
+    in.last = data;
+    in.end = data + len;
+
+    total = 0;
+
+    do {
+        in.pos = in.last;
+        in.last = in.pos + ngx_min(BENCH_READ_SIZE, (size_t) (in.end - in.pos));
+
+        last = (in.last == in.end);
+
+        for ( ;; ) {
+            if (engine->type == BENCH_JS) {
+                rc = jsmin(&js, &in, &b, last);
+
+            } else {
+                rc = cssmin(&css, &in, &b, last);
+            }
+
+            if (rc != NGX_AGAIN) {
+                break;
+            }
+
+            total += b.last - b.pos;
+            b.last = b.pos;
+        }
+
+    } while (!last);
+
+    return total + (b.last - b.pos);
+}
+
+
+static double
+bench_now(void)
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+#if (NGX_BENCH_ALLOCS)
+
+/*
+ * With the linker wrapping malloc(), calloc() and realloc() the heap
+ * allocations made while the cases run are counted; the engines should
+ * make none.
+ */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+
+void *
+__wrap_malloc(size_t size)
+{
+    bench_allocs += bench_counting;
+    return __real_malloc(size);
+}
+
+
+void *
+__wrap_calloc(size_t n, size_t size)
+{
+    bench_allocs += bench_counting;
+    return __real_calloc(n, size);
+}
+
+
+void *
+__wrap_realloc(void *p, size_t size)
+{
+    bench_allocs += bench_counting;
+    return __real_realloc(p, size);
+}
+
+#endif
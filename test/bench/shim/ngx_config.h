@@ -0,0 +1,24 @@
+
+/*
+ * The parts of ngx_config.h the minifiers need, so that they can be built
+ * without nginx for minify_bench.
+ */
+
+
+#ifndef _NGX_CONFIG_H_INCLUDED_
+#define _NGX_CONFIG_H_INCLUDED_
+
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+typedef intptr_t        ngx_int_t;
+typedef uintptr_t       ngx_uint_t;
+typedef intptr_t        ngx_flag_t;
+
+
+#endif /* _NGX_CONFIG_H_INCLUDED_ */
@@ -0,0 +1,41 @@
+
+/*
+ * The parts of ngx_core.h the minifiers need: the output and input buffers
+ * are plain memory, so ngx_buf_t only has the pointers jsmin() and cssmin()
+ * use.
+ */
+
+
+#ifndef _NGX_CORE_H_INCLUDED_
+#define _NGX_CORE_H_INCLUDED_
+
+
+#include <ngx_config.h>
+
+
+typedef unsigned char  u_char;
+
+
+#define NGX_OK          0
+#define NGX_ERROR      -1
+#define NGX_AGAIN      -2
+#define NGX_DECLINED   -5
+
+
+#define ngx_memzero(buf, n)       (void) memset(buf, 0, n)
+#define ngx_memcpy(dst, src, n)   (void) memcpy(dst, src, n)
+#define ngx_cpymem(dst, src, n)   (((u_char *) memcpy(dst, src, n)) + (n))
+
+#define ngx_max(val1, val2)  ((val1 < val2) ? (val2) : (val1))
+#define ngx_min(val1, val2)  ((val1 > val2) ? (val2) : (val1))
+
+
+typedef struct {
+    u_char      *pos;
+    u_char      *last;
+    u_char      *start;
+    u_char      *end;
+} ngx_buf_t;
+
+
+#endif /* _NGX_CORE_H_INCLUDED_ */
@@ -0,0 +1,92 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 jsmin with more output than minify_buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_buffers 2 256;
+    minify_exact_length 0;
+--- user_files eval
+">>> a.js\n" . ("alert('a');\n" x 300)
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}" . ("alert('a');" x 300)
+
+
+
+=== TEST 0:1 cssmin with more output than minify_buffers without sendfile
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile off;
+output_buffers 1 1024;
+--- config
+    minify on;
+    minify_buffers 1 256;
+    minify_exact_length 0;
+--- user_files eval
+">>> a.css\n" . ("a {\n    color: red;\n}\n" x 200)
+--- request
+    GET /a.css
+--- response_body eval
+"a{color: red;}" x 200
+
+
+
+=== TEST 0:2 jsmin with an identifier longer than minify_buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_buffers 2 256;
+    minify_exact_length 0;
+--- user_files eval
+">>> a.js\n" . ("a" x 1000) . " = 1;\n"
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}" . ("a" x 1000) . "=1;"
+
+
+
+=== TEST 0:3 htmlmin with an inline script longer than minify_buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_buffers 2 256;
+    minify_exact_length 0;
+--- user_files eval
+">>> a.html\n<script>\n  var " . ("a" x 1000) . " = 1;\n</script>\n"
+--- request
+    GET /a.html
+--- response_body eval
+"<script>var " . ("a" x 1000) . "=1;</script>"
@@ -0,0 +1,103 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+repeat_each(2);
+plan tests => repeat_each() * blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 shorter than minify_min_length
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_min_length 100;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"alert('a');\nalert('b');\nalert('c');\n"
+
+
+
+=== TEST 0:1 longer than minify_max_length
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_max_length 10;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"alert('a');\nalert('b');\nalert('c');\n"
+
+
+
+=== TEST 0:2 between minify_min_length and minify_max_length
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_min_length 10;
+    minify_max_length 100;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:3 a .min.js file is sent as is
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+--- user_files
+>>> a.min.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.min.js
+--- response_body eval
+"alert('a');\nalert('b');\nalert('c');\n"
@@ -0,0 +1,213 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+repeat_each(2);
+plan tests => repeat_each() * (blocks() * 2 + 2);
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 jsmin served from minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:1 cssmin served from minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"body{margin: 0;}"
+
+
+
+=== TEST 0:2 minify_cache off
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+minify_cache zone=minify:1m;
+--- config
+    minify on;
+    minify_cache off;
+--- user_files
+>>> a.js
+alert('a');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');"
+
+
+
+=== TEST 0:3 jsmin served from minify_cache_path
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache_path minify_cache levels=1:2 max_size=1m;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:4 minify_cache_path behind minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+    minify_cache_path minify_cache;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"body{margin: 0;}"
+
+
+
+=== TEST 0:5 minify_cache with the output in several buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile off;
+output_buffers 1 16;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+    minify_cache_path minify_cache levels=1:2;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+    padding: 0;
+}
+a {
+    color: red;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"body{margin: 0;padding: 0;}a{color: red;}"
+
+
+
+=== TEST 0:6 minify_cache_gzip sends the minified bytes without Accept-Encoding
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+    minify_cache_path minify_cache;
+    minify_cache_gzip on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+alert('d');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');alert('d');"
+
+
+
+=== TEST 0:7 minify_cache_gzip sends the gzip variant with Vary on a hit
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+    minify_cache_gzip on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+alert('d');
+--- more_headers
+Accept-Encoding: gzip
+--- pipelined_requests eval
+["GET /a.js", "GET /a.js"]
+--- raw_response_headers_like eval
+["\\AHTTP/1\\.1 200 OK\r\n",
+ "Content-Encoding: gzip\r\n.*Vary: Accept-Encoding\r\n"]
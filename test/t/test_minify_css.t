@@ -1,7 +1,7 @@
 use lib 'lib';
 use Shell;
 use Test::Nginx::Socket;
-plan tests => blocks() * 2;
+plan tests => blocks() * 2 + 2;
 run_tests();
 
 
@@ -40,7 +40,7 @@ body {
 --- request
     GET /a.css
 --- response_body eval 
-"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;} " 
+"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;}" 
 
 
 === TEST 0:1 jsmin without sendfile
@@ -76,7 +76,7 @@ body {
     GET /a.css
 --- response_body eval 
 
-"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;} " 
+"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;}" 
 
 
 === TEST 0:2 jsmin with gzipon without sendfile 
@@ -112,7 +112,7 @@ body {
 --- request
     GET /a.css
 --- response_body eval 
-"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;} " 
+"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;}" 
 
 === TEST 0:3 jsmin without minify 
 --- http_config
@@ -198,7 +198,7 @@ body {
 --- request
     GET /a.css
 --- response_body eval
-"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;} " 
+"\@charset \"utf-8\";*{outline: 0;padding: 0;margin: 0;border: 0;}body{font-size: 12px;font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;text-align:center;margin:0 auto;background-color: #E8E7E7;position:relative;}" 
 
 === TEST 0:5 jsmin with sendfile on and empty file
 --- http_config
@@ -219,3 +219,93 @@ sendfile on;
 --- response_body: 
 
 
+
+=== TEST 0:6 cssmin with tokens spanning buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    output_buffers 1 16;
+--- user_files
+>>> a.css
+a {
+    background: url(data:image/png;base64,AAAA);
+    /* a comment longer than one buffer */
+    color: red;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"a{background: url(data:image/png;base64,AAAA);color: red;}"
+
+
+=== TEST 0:7 cssmin state does not leak between requests
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.css
+a {
+    color: red;
+/* unterminated comment
+>>> b.css
+b {
+    margin: 0;
+}
+--- pipelined_requests eval
+["GET /a.css", "GET /b.css"]
+--- response_body eval
+["a{color: red;", "b{margin: 0;}"]
+
+
+=== TEST 0:8 cssmin drops the whitespace before a selector
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.css
+  a {
+    color: red;
+}
+
+  b { margin: 0; }
+--- request
+    GET /a.css
+--- response_body eval
+"a{color: red;}b{margin: 0;}"
+
+
+=== TEST 0:9 cssmin drops the whitespace after an at-rule
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.css
+@import "a.css"; @import "b.css";  a { color: red; }
+--- request
+    GET /a.css
+--- response_body eval
+"\@import \"a.css\";\@import \"b.css\";a{color: red;}"
@@ -0,0 +1,128 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 cssmin with the machine engine
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_css_engine machine;
+--- user_files
+>>> a.css
+@charset "utf-8";
+/* CSS Document */
+* {
+    outline: 0;
+    padding: 0;
+}
+
+body {
+    font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;
+    margin:0 auto;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"\@charset \"utf-8\";*{outline: 0;padding: 0;}body{font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;margin:0 auto;}"
+
+
+
+=== TEST 0:1 cssmin with the scan engine
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_css_engine scan;
+--- user_files
+>>> a.css
+@charset "utf-8";
+/* CSS Document */
+* {
+    outline: 0;
+    padding: 0;
+}
+
+body {
+    font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;
+    margin:0 auto;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"\@charset \"utf-8\";*{outline: 0;padding: 0;}body{font-family: '宋体' ,Arial, Helvetica, Garuda, sans-serif;margin:0 auto;}"
+
+
+
+=== TEST 0:2 at-rules, comments and data URIs with the machine engine
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_css_engine machine;
+    output_buffers 1 16;
+--- user_files
+>>> a.css
+@import url("a.css");
+@media screen {
+.nav  >  li a:hover,
+.nav li.active {
+    color :  #333;  /* text */
+    background: url(data:image/png;base64,AAAA;BBBB) no-repeat;
+    font: 12px/1.5 "Helvetica Neue", Arial;
+}
+}
+--- request
+    GET /a.css
+--- response_body eval
+"\@import url(\"a.css\");\@media screen {.nav > li a:hover,.nav li.active { color : #333;background: url(data:image/png;base64,AAAA;BBBB) no-repeat;font: 12px/1.5 \"Helvetica Neue\", Arial;}}"
+
+
+
+=== TEST 0:3 at-rules, comments and data URIs with the scan engine
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_css_engine scan;
+    output_buffers 1 16;
+--- user_files
+>>> a.css
+@import url("a.css");
+@media screen {
+.nav  >  li a:hover,
+.nav li.active {
+    color :  #333;  /* text */
+    background: url(data:image/png;base64,AAAA;BBBB) no-repeat;
+    font: 12px/1.5 "Helvetica Neue", Arial;
+}
+}
+--- request
+    GET /a.css
+--- response_body eval
+"\@import url(\"a.css\");\@media screen {.nav > li a:hover,.nav li.active { color : #333;background: url(data:image/png;base64,AAAA;BBBB) no-repeat;font: 12px/1.5 \"Helvetica Neue\", Arial;}}"
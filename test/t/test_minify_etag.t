@@ -0,0 +1,138 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+repeat_each(2);
+plan tests => repeat_each() * blocks() * 3;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 ETag of a minified file
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_headers
+ETag: "a05cd8b6d6da3956"
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:1 If-None-Match without minify cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- more_headers
+If-None-Match: "a05cd8b6d6da3956"
+--- request
+    GET /a.js
+--- response_headers
+ETag: "a05cd8b6d6da3956"
+--- response_body
+--- error_code: 304
+
+
+
+=== TEST 0:2 If-None-Match answered from minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- more_headers
+If-None-Match: "a05cd8b6d6da3956"
+--- request
+    GET /a.js
+--- response_headers
+ETag: "a05cd8b6d6da3956"
+--- response_body
+--- error_code: 304
+
+
+
+=== TEST 0:3 If-None-Match answered from minify_cache_path
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_cache_path minify_cache levels=1:2;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- more_headers
+If-None-Match: "0000000000000000", W/"ef5462562d1d7216"
+--- request
+    GET /a.css
+--- response_headers
+ETag: "ef5462562d1d7216"
+--- response_body
+--- error_code: 304
+
+
+
+=== TEST 0:4 If-None-Match not matching
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- more_headers
+If-None-Match: "0000000000000000"
+--- request
+    GET /a.css
+--- response_headers
+ETag: "ef5462562d1d7216"
+--- response_body eval
+"body{margin: 0;}"
@@ -0,0 +1,107 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 htmlmin collapses whitespace and removes comments
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_types text/html;
+--- user_files
+>>> a.html
+<html>
+  <body>
+    <!-- a comment -->
+    <p class = "a  b">a   b</p>
+  </body>
+</html>
+--- request
+    GET /a.html
+--- response_body eval
+"<html>\x{0a}<body>\x{0a}<p class=\"a  b\">a b</p>\x{0a}</body>\x{0a}</html>"
+
+
+
+=== TEST 0:1 htmlmin keeps pre and textarea
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_types text/html;
+--- user_files
+>>> a.html
+<pre>
+ a  b
+</pre>
+<textarea>  x  </textarea>
+--- request
+    GET /a.html
+--- response_body eval
+"<pre>\x{0a} a  b\x{0a}</pre>\x{0a}<textarea>  x  </textarea>"
+
+
+
+=== TEST 0:2 htmlmin minifies script and style
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_types text/html;
+--- user_files
+>>> a.html
+<script>
+  var a = "</p>  x";
+  alert( a );
+</script>
+<style>
+  p { color: red; }
+</style>
+--- request
+    GET /a.html
+--- response_body eval
+"<script>var a=\"</p>  x\";alert(a);</script>\x{0a}<style>p{color: red;}</style>"
+
+
+
+=== TEST 0:3 htmlmin keeps scripts of other types
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_types text/html;
+    output_buffers 1 16;
+--- user_files
+>>> a.html
+<script type="text/template">
+  <div>  {{x}}  </div>
+</script>
+--- request
+    GET /a.html
+--- response_body eval
+"<script type=\"text/template\">\x{0a}  <div>  {{x}}  </div>\x{0a}</script>"
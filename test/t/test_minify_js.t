@@ -143,3 +143,69 @@ sendfile on;
 
 
 
+
+=== TEST 0:6 jsmin with tokens spanning buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    output_buffers 1 16;
+--- user_files
+>>> a.js
+/* a comment longer than one buffer */
+var s = "a string longer than one buffer";
+alert(s); // done
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}var s=\"a string longer than one buffer\";alert(s);"
+
+
+
+=== TEST 0:7 jsmin from a mapped file
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_mmap on;
+--- user_files
+>>> a.js
+/* a comment */
+var s = "a string";
+alert(s); // done
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}var s=\"a string\";alert(s);"
+
+
+
+=== TEST 0:8 jsmin with literals longer than minify_buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_buffers 2 256;
+    minify_exact_length 0;
+--- user_files eval
+">>> a.js\nvar s = \"" . ("b" x 1000) . "\";\nvar r = /" . ("c" x 1000) . "/g;\n"
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}var s=\"" . ("b" x 1000) . "\";var r=/" . ("c" x 1000) . "/g;"
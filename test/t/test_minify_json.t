@@ -0,0 +1,78 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 jsonmin keeps strings
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/json                      json;
+}
+
+--- config
+    minify on;
+    minify_types application/json;
+--- user_files
+>>> a.json
+{
+    "name": "a  \" b",
+    "list": [ 1, 2,
+              3 ],
+    "empty": { }
+}
+--- request
+    GET /a.json
+--- response_body eval
+"{\"name\":\"a  \\\" b\",\"list\":[1,2,3],\"empty\":{}}"
+
+
+
+=== TEST 0:1 jsonmin with strings spanning buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/json                      json;
+}
+
+--- config
+    minify on;
+    minify_types application/json;
+    output_buffers 1 16;
+--- user_files
+>>> a.json
+[
+    "a string longer than one buffer \\",
+    "another one with \"quotes\" in it"
+]
+--- request
+    GET /a.json
+--- response_body eval
+"[\"a string longer than one buffer \\\\\",\"another one with \\\"quotes\\\" in it\"]"
+
+
+
+=== TEST 0:2 jsonmin for a structured syntax suffix
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/ld+json                   jsonld;
+}
+
+--- config
+    minify on;
+    minify_types application/ld+json;
+--- user_files
+>>> a.jsonld
+{ "@context": "https://schema.org" }
+--- request
+    GET /a.jsonld
+--- response_body eval
+"{\"\@context\":\"https://schema.org\"}"
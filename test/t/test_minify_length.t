@@ -0,0 +1,126 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 3;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 exact Content-Length of a minified file
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_headers
+Content-Length: 34
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:1 exact Content-Length without sendfile
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile off;
+output_buffers 1 16;
+--- config
+    minify on;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- request
+    GET /a.css
+--- response_headers
+Content-Length: 16
+--- response_body eval
+"body{margin: 0;}"
+
+
+
+=== TEST 0:2 larger than minify_exact_length
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_exact_length 8;
+--- user_files
+>>> a.js
+alert('a');
+--- request
+    GET /a.js
+--- response_headers
+!Content-Length
+--- response_body eval
+"\x{0a}alert('a');"
+
+
+
+=== TEST 0:3 exact Content-Length from minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+--- user_files
+>>> a.js
+alert('a');
+--- request
+    GET /a.js
+--- response_headers
+Content-Length: 12
+--- response_body eval
+"\x{0a}alert('a');"
+
+
+
+=== TEST 0:4 streamed when the output does not fit in minify_buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_buffers 2 256;
+--- user_files eval
+">>> a.js\n" . ("alert('a');\n" x 100)
+--- request
+    GET /a.js
+--- response_headers
+!Content-Length
+--- response_body eval
+"\x{0a}" . ("alert('a');" x 100)
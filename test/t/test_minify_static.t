@@ -0,0 +1,127 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 minify_static serves the .min.js sibling as is
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_static on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+>>> a.min.js
+alert( 'prebuilt' );
+--- request
+    GET /a.js
+--- response_body
+alert( 'prebuilt' );
+
+
+
+=== TEST 0:1 minify_static falls back to live minification
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_static on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');"
+
+
+
+=== TEST 0:2 minify_static always with css
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_static always;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+>>> a.min.css
+body { margin: 1px; }
+--- request
+    GET /a.css
+--- response_body
+body { margin: 1px; }
+
+
+
+=== TEST 0:3 minify_static off
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_static off;
+--- user_files
+>>> a.js
+alert('a');
+>>> a.min.js
+alert( 'prebuilt' );
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');"
+
+
+
+=== TEST 0:4 minify_static with minify off
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify off;
+    minify_static on;
+--- user_files
+>>> a.js
+alert('a');
+>>> a.min.js
+alert( 'prebuilt' );
+--- request
+    GET /a.js
+--- response_body
+alert('a');
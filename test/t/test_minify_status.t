@@ -0,0 +1,135 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+repeat_each(1);
+# TEST 0:2 makes three requests, TEST 0:3 two
+
+plan tests => repeat_each() * (blocks() * 2 + 6);
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 minify_status json
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+--- config
+    minify_metrics zone=minify_metrics:32k;
+
+    location /js/ {
+        minify on;
+    }
+
+    location = /minify_status {
+        minify_status;
+    }
+--- request
+    GET /minify_status
+--- response_body eval
+qr/^\{"zone":"minify_metrics","locations":\[\n\{"server":"[^"]*","location":"\/js\/","index":0,"engines":\{"js":\{"requests":0,"bytes_in":0,"bytes_out":0,"time_us":0\},.*"cache":\{"hits":0,"misses":0\},"bypassed":\{"status":0,"encoding":0,"header_only":0,"type":0,"length":0,"minified":0,"static":0\}\}\n\]\}\n$/s
+
+
+
+=== TEST 0:1 minify_status prometheus
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+--- config
+    minify_metrics zone=minify_metrics:32k;
+
+    location /js/ {
+        minify on;
+    }
+
+    location = /minify_status {
+        minify_status prometheus;
+    }
+--- request
+    GET /minify_status
+--- response_body eval
+qr/^# HELP nginx_minify_requests_total .*\nnginx_minify_requests_total\{server="[^"]*",location="\/js\/",index="0",engine="js"\} 0\n.*nginx_minify_bypassed_total\{server="[^"]*",location="\/js\/",index="0",reason="static"\} 0\n$/s
+
+
+
+=== TEST 0:2 minify_status counts minified and static responses
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+--- config
+    minify_metrics zone=minify_metrics:32k;
+
+    location /js/ {
+        minify on;
+        minify_static on;
+    }
+
+    location = /minify_status {
+        minify_status;
+    }
+--- user_files
+>>> js/a.js
+alert( 'a' );
+>>> js/b.js
+alert( 'b' );
+>>> js/b.min.js
+alert('b');
+--- pipelined_requests eval
+["GET /js/a.js", "GET /js/b.js", "GET /minify_status"]
+--- response_body eval
+["\x{0a}alert('a');",
+ "alert('b');\n",
+ qr/"location":"\/js\/","index":0,"engines":\{"js":\{"requests":1,"bytes_in":14,"bytes_out":12,"time_us":\d+\},"css":\{"requests":0,.*"cache":\{"hits":0,"misses":0\},"bypassed":\{"status":0,"encoding":0,"header_only":0,"type":0,"length":0,"minified":0,"static":1\}\}/s]
+
+
+
+=== TEST 0:3 minify_status counts same-named locations apart
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+minify_metrics zone=minify_metrics:32k;
+
+server {
+    listen 127.0.0.1:1985;
+
+    location / {
+        minify on;
+    }
+}
+
+server {
+    listen 127.0.0.1:1986;
+
+    location / {
+        minify on;
+    }
+}
+--- config
+    location /one/ {
+        proxy_pass http://127.0.0.1:1985/;
+    }
+
+    location = /minify_status {
+        minify_status;
+    }
+--- user_files
+>>> a.js
+alert( 'a' );
+--- pipelined_requests eval
+["GET /one/a.js", "GET /minify_status"]
+--- response_body eval
+["\x{0a}alert('a');",
+ qr/^\{"zone":"minify_metrics","locations":\[\n\{"server":"","location":"\/","index":0,"engines":\{"js":\{"requests":1,.*\},\n\{"server":"","location":"\/","index":1,"engines":\{"js":\{"requests":0,.*\}\n\]\}\n$/s]
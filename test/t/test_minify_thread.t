@@ -0,0 +1,224 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+repeat_each(2);
+plan tests => repeat_each() * blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 jsmin in a thread with sendfile on
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_thread_pool default threshold=1;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:1 cssmin in a thread without sendfile
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile off;
+--- config
+    minify on;
+    minify_thread_pool default threshold=1;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"body{margin: 0;}"
+
+
+
+=== TEST 0:2 jsmin in a thread, small buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile off;
+output_buffers 1 16;
+--- config
+    minify on;
+    minify_thread_pool default threshold=1;
+--- user_files
+>>> a.js
+var s = "a string longer than one buffer";
+alert(s);
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}var s=\"a string longer than one buffer\";alert(s);"
+
+
+
+=== TEST 0:3 jsmin in a thread stored in minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_cache zone=minify:1m;
+    minify_thread_pool default threshold=1;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');"
+
+
+
+=== TEST 0:4 below the threshold
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_thread_pool default threshold=1m;
+--- user_files
+>>> a.js
+alert('a');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');"
+
+
+
+=== TEST 0:5 jsmin reading the file with aio threads
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+aio threads;
+--- config
+    minify on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+alert('c');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');alert('c');"
+
+
+
+=== TEST 0:6 jsmin in a thread with more output than minify_buffers
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_buffers 2 256;
+    minify_exact_length 0;
+    minify_thread_pool default threshold=1;
+--- user_files eval
+">>> a.js\n" . ("alert('a');\n" x 3000)
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}" . ("alert('a');" x 3000)
+
+
+
+=== TEST 0:7 client abort during an aio threads read
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile off;
+aio threads;
+--- config
+    minify on;
+--- user_files eval
+">>> a.js\n" . ("alert('a');\n" x 400000)
+--- request
+    GET /a.js
+--- timeout: 10ms
+--- abort
+--- ignore_response
+--- wait: 0.5
+--- no_error_log
+[alert]
+[crit]
+
+
+
+=== TEST 0:8 client abort while a minify task is posted
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+sendfile on;
+--- config
+    minify on;
+    minify_thread_pool default threshold=1;
+--- user_files eval
+">>> a.js\n" . ("alert('a');\n" x 400000)
+--- request
+    GET /a.js
+--- timeout: 10ms
+--- abort
+--- ignore_response
+--- wait: 0.5
+--- no_error_log
+[alert]
+[crit]
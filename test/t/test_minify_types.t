@@ -0,0 +1,96 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 jsmin for text/javascript by default
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    text/javascript                       js;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');"
+
+
+
+=== TEST 0:1 jsmin for a type mapped to the js engine
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-js                      js;
+}
+
+--- config
+    minify on;
+    minify_types application/x-js=js;
+    charset utf-8;
+    charset_types application/x-js;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+--- request
+    GET /a.js
+--- response_body eval
+"\x{0a}alert('a');alert('b');"
+
+
+
+=== TEST 0:2 no minify for a type not in minify_types
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_types text/css;
+--- user_files
+>>> a.js
+alert('a');
+alert('b');
+--- request
+    GET /a.js
+--- response_body eval
+"alert('a');\x{0a}alert('b');\x{0a}"
+
+
+
+=== TEST 0:3 cssmin for any type with minify_types *
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/x-css                            css;
+    application/x-javascript              js;
+}
+
+--- config
+    minify on;
+    minify_types *;
+--- user_files
+>>> a.css
+body {
+    margin: 0;
+}
+--- request
+    GET /a.css
+--- response_body eval
+"body{margin: 0;}"
@@ -0,0 +1,69 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+repeat_each(1);
+
+# every block makes three requests
+
+plan tests => repeat_each() * blocks() * 6;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 variables of a miss and a hit of minify_cache
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+log_format  minify  '$minify_bytes_in $minify_bytes_out $minify_ratio '
+                    '$minify_time_us $minify_cache_status';
+--- config
+    access_log  html/minify.log  minify;
+
+    location /js/ {
+        minify on;
+        minify_cache zone=minify:1m;
+    }
+--- user_files
+>>> js/a.js
+alert( 'a' );
+--- pipelined_requests eval
+["GET /js/a.js", "GET /js/a.js", "GET /minify.log"]
+--- response_body eval
+["\x{0a}alert('a');",
+ "\x{0a}alert('a');",
+ qr/^14 12 1\.17 \d+ MISS\n14 12 1\.17 0 HIT\n$/]
+
+
+
+=== TEST 0:1 variables of minify_cache_path
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/x-javascript              js;
+}
+
+log_format  minify  '$minify_bytes_in $minify_bytes_out $minify_ratio '
+                    '$minify_time_us $minify_cache_status';
+
+minify_cache_path minify_cache;
+--- config
+    access_log  html/minify.log  minify;
+
+    location /js/ {
+        minify on;
+    }
+--- user_files
+>>> js/a.js
+alert( 'a' );
+--- pipelined_requests eval
+["GET /js/a.js", "GET /js/a.js", "GET /minify.log"]
+--- response_body eval
+["\x{0a}alert('a');",
+ "\x{0a}alert('a');",
+ qr/^14 12 1\.17 \d+ MISS\n14 12 1\.17 0 HIT\n$/]
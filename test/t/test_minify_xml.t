@@ -0,0 +1,81 @@
+use lib 'lib';
+use Shell;
+use Test::Nginx::Socket;
+plan tests => blocks() * 2;
+run_tests();
+
+
+__DATA__
+
+=== TEST 0:0 xmlmin removes comments and editor data from svg
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    image/svg+xml                         svg;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.svg
+<svg xmlns="http://www.w3.org/2000/svg"
+     xmlns:inkscape="http://www.inkscape.org/namespaces/inkscape"
+     inkscape:version="1.0">
+  <!-- an icon -->
+  <metadata>
+    <title>x</title>
+  </metadata>
+  <path d="M 0,0 L 10,10" />
+</svg>
+--- request
+    GET /a.svg
+--- response_body eval
+"<svg xmlns=\"http://www.w3.org/2000/svg\"><path d=\"M 0,0 L 10,10\"/></svg>"
+
+
+
+=== TEST 0:1 xmlmin keeps the spaces between the parts of svg text
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    image/svg+xml                         svg;
+}
+
+--- config
+    minify on;
+--- user_files
+>>> a.svg
+<svg>
+  <text><tspan>a</tspan> <tspan>b</tspan></text>
+</svg>
+--- request
+    GET /a.svg
+--- response_body eval
+"<svg><text><tspan>a</tspan> <tspan>b</tspan></text></svg>"
+
+
+
+=== TEST 0:2 xmlmin keeps xml:space="preserve"
+--- http_config
+types {
+    text/html                             html htm shtml;
+    text/css                              css;
+    application/xml                       xml;
+}
+
+--- config
+    minify on;
+    minify_types application/xml;
+--- user_files
+>>> a.xml
+<?xml version="1.0"?>
+<doc>
+  <a>  text   here </a>
+  <b xml:space="preserve">  kept   as is </b>
+</doc>
+--- request
+    GET /a.xml
+--- response_body eval
+"<?xml version=\"1.0\"?><doc><a> text here </a><b xml:space=\"preserve\">  kept   as is </b></doc>"